@@ -51,6 +51,8 @@
 //    cl /O2 /MT /DNDEBUG /I "%VCPKG_ROOT%\installed\x64-windows-static-release\include" stars.c resource.res /link /SUBSYSTEM:WINDOWS /LIBPATH:"%VCPKG_ROOT%\installed\x64-windows-static-release\lib" SDL3-static.lib user32.lib gdi32.lib winmm.lib shell32.lib advapi32.lib ole32.lib oleaut32.lib setupapi.lib cfgmgr32.lib imm32.lib version.lib
 
 
+#include <math.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -58,20 +60,33 @@
 #include <string.h>
 #include <time.h>
 #include <windows.h>        // CP_UTF8
+#include <dbghelp.h>        // SYMBOL_INFO, functions are loaded at run time
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>  // SDL3: include explicitly for main()
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define R_SSE2                      // SSE2 blending paths
+#endif
+
+#define R_TILESTATS                     // per-tile cost counters (F6 overlay), comment out to compile out
+
 #define CONFIG_FILENAME "stars.ini"
 #define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)<(b)?(a):(b))
 #define BETWEEN(l, u, x) (((x) < (l)) ? (l) : ((x) > (u)) ? (u) : (x))
 #define MAXSTARS 500
+#define MAXVIEWS 8
+#define MAXSIZE 16                        // largest star size
 
 
 static SDL_Window *sdl_window;            // program window created by SDL
 static SDL_Renderer *sdl_renderer;        // renderer created by SDL
 static int render_w = 800;                // initial window width
 static int render_h = 600;                // initial window height
+static int world_w = 800;                 // width of the simulated star field
+static int world_h = 600;                 // height of the simulated star field
 static uint32_t m_rand_seed = 1;          // initial random seed
 
 #define TICRATE 35                        // tics in second (as in Doom)
@@ -92,21 +107,405 @@ typedef struct
     float speed;           // movement speed
     int brightness;        // current brightness (0..255)
     short r, g, b;         // base color
+    short size_r;          // random draw for the size class, see R_StarSize
+    float px, py;          // position a frame ago, for motion blur
+    int pb;                // brightness a frame ago
+
+    // Counter-based mode: state at birth, see R_SeekStars
+    float x0;              // position at birth
+    int b0;                // brightness at birth
+    uint32_t gen;          // generation (number of respawns)
+    Uint64 birth;          // star_tic of birth
+    Uint64 life;           // updates until the next respawn
 } star_t;
 
-static star_t stars[MAXSTARS];
+// Two fields, so a scene playlist can crossfade from one to the other
+static star_t star_fields[2][MAXSTARS];
+static star_t *stars = star_fields[0];    // the field being shown
+static star_t *back_stars = star_fields[1]; // the incoming one, see PL_Swap
+static float field_fade = 1.0f;           // brightness of the field being drawn
+
+#define MIN_ZOOM 0.125f
+#define MAX_ZOOM 8.0f
+
+// Star sprite mip chain, 8 px and up in doublings to the largest side
+// R_GetSprite is asked for: a MAXSIZE star, halo included, at MAX_ZOOM
+#define SPRITE_MAX_SIDE (MAXSIZE * (int)MAX_ZOOM * 2)
+#define SPRITE_LEVELS (SPRITE_MAX_SIDE <= 8 ? 1 : SPRITE_MAX_SIDE <= 16 ? 2 : SPRITE_MAX_SIDE <= 32 ? 3 \
+                     : SPRITE_MAX_SIDE <= 64 ? 4 : SPRITE_MAX_SIDE <= 128 ? 5 : SPRITE_MAX_SIDE <= 256 ? 6 \
+                     : SPRITE_MAX_SIDE <= 512 ? 7 : 8)
+
+typedef struct
+{
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Rect rect;                        // visible part of the star field
+    SDL_Texture *aurora_tex;              // this view's part of the aurora
+    SDL_Rect aurora_rect;                 // that part, in aurora buffer pixels
+    Uint64 aurora_tic;                    // tic of the uploaded aurora
+    SDL_Texture *sprites[SPRITE_LEVELS];  // star sprite mip chain, see R_GetSprite
+    SDL_Texture *scene;                   // last star field drawn, see R_GetScene
+    int scene_w, scene_h;
+    Uint32 scene_key;                     // frame_key the scene was drawn for
+    bool scene_valid;
+    SDL_Texture **pano_tex;               // panorama tile cache, see R_SizePanoCaches
+    Uint32 *pano_key;
+    Uint64 *pano_used;
+    int pano_slots;
+    int pano_ring;                        // tiles prefetched around the visible ones
+} view_t;
+
+static view_t views[MAXVIEWS];            // one per window, views[0] is primary
+static int num_views;
+static bool spanning;                     // field is laid out over the displays
+
+static float zoom = 1.0f;                 // field pixels per star field unit
+static float cam_x, cam_y;                // field position shown at the view origin
+
+static bool on_battery;                   // battery profile is active
+
+//
+// Scene playlist: settings that make up a scene's star field; the rest
+// of the config is shared by all scenes.
+//
+
+#define MAXSCENES 16
+
+typedef struct
+{
+    int num_stars, brightness_step, colored_stars, star_speed;
+    int star_size, size_dist, size_falloff, shapes[3];
+    int aurora, motion_blur;
+} scene_params_t;
+
+typedef struct
+{
+    char text[192];                       // config line: seconds, key=value...
+    int seconds;
+    scene_params_t params;
+} scene_t;
+
+static scene_t scenes[MAXSCENES];
+static int num_scenes;
+static int pl_scene = -1;                 // scene being shown, -1 = no playlist
+static Uint64 pl_fade_start;              // ms, 0 = not crossfading
+static float pl_fade;                     // crossfade progress (0..1)
+static scene_params_t pl_incoming;        // settings of the other field
+
+// Next scene's field: the main thread asks (IDLE -> REQUESTED), the idle
+// worker delivers (REQUESTED -> READY); a request that went out of date
+// while the worker had it is marked STALE and dropped by the worker
+enum { PL_IDLE, PL_REQUESTED, PL_STALE, PL_READY };
+static SDL_AtomicInt pl_prewarm;
 
 
 // ------------------------- Parameters (configurable) -------------------------
 static int FULLSCREEN       = 1;     // full screen mode
 static int NUM_STARS        = 100;   // number of stars (0..MAXSTARS)
 static int DELAY_MS         = 15;    // delay between frames (ms)
-static int BRIGHTNESS_STEP  = 1;     // brightness decrement per frame (1..255)
+static int BRIGHTNESS_STEP  = 1;     // brightness decrement per frame (0 = no fading..255)
 static int COLORED_STARS    = 1;     // 1 = random RGB, 0 = grayscale
 static int STAR_SIZE        = 3;     // size of the star (1...16)
+static int SIZE_DIST        = 0;     // 1 = sizes 1..STAR_SIZE, small ones more common
+static int SIZE_FALLOFF     = 40;    // % of stars in each size class vs. the one below
+static int SHAPE_DISC_MIN   = 256;   // brightness from which stars are round (256 = never)
+static int SHAPE_CROSS_MIN  = 256;   // brightness from which stars are crosses
+static int SHAPE_SPIKES_MIN = 256;   // brightness from which stars get diffraction spikes
 static int STAR_SPEED       = -3;    // movement speed and direction (-10...0...10)
 static int SHOW_FPS         = 0;     // 1 = show fps counter
+static int AURORA           = 0;     // 1 = draw aurora curtains behind the stars
+static int FLOW_FIELD       = 0;     // 1 = drift along a swirling flow field
+static int FLOW_GRID        = 32;    // flow grid cells across the screen (4..256)
+static int FLOW_EVOLVE      = 10;    // flow field evolution speed (0..100)
+static int COUNTER_RNG      = 0;     // 1 = per-star counter-based RNG (seekable field)
+static int RESPAWN_RING     = 0;     // 1 = prepare respawns on a background thread
+static int SPAN_DISPLAYS    = 0;     // 1 = one star field across all displays
+static int BEZEL_GAP        = 0;     // hidden pixels between displays (0..1000)
+static int RENDER_SCALE     = 100;   // star field resolution in % of the window (25..100)
+static int STATIC_CACHE     = 0;     // 1 = reuse the last frame while nothing changes
+static int PANORAMA         = 0;     // 1 = draw panorama.sky behind the stars
+static int PANORAMA_DRIFT   = -2;    // panorama scroll in 1/10 pixel per tic (-100..100)
+static int JOB_THREADS      = 0;     // job workers besides the main thread (0 = one per core)
+static int MOTION_BLUR      = 0;     // 1 = stretch moving stars along their motion
+static int POWER_PROFILES   = 1;     // 1 = switch to the battery profile when unplugged
+static int BATTERY_DELAY_MS = 33;    // on battery: delay between frames (ms)
+static int BATTERY_STARS    = 50;    // on battery: number of stars
+static int BATTERY_EFFECTS  = 0;     // on battery: 1 = keep aurora and flow field
+static int BATTERY_SCALE    = 50;    // on battery: render scale (25..100)
+static int SCENE_FADE_MS    = 3000;  // crossfade between playlist scenes (ms)
+// -----------------------------------------------------------------------------
+
+
 // -----------------------------------------------------------------------------
+// Lockstep: several processes sharing one clock (video walls)
+// -----------------------------------------------------------------------------
+
+#define LOCKSTEP_NAME "Local\\StarrySkyLockstep"
+#define LOCKSTEP_TAKEOVER_MS 1000         // stale clock before a follower leads
+
+typedef struct
+{
+    volatile LONG   ready;                // leader published seed and field size
+    volatile LONG   leader;               // process id of the leader
+    uint32_t        seed;                 // RNG seed of the shared field
+    int32_t         field_w, field_h;     // size of the shared field
+    volatile LONG64 gametic;              // tic published by the leader
+} lockstep_t;
+
+static HANDLE lockstep_map;
+static lockstep_t *lockstep;              // shared block, NULL when not in lockstep
+static bool lockstep_leader;              // this process drives the clock
+static Uint64 lockstep_tic;               // last tic read from the leader
+static Uint64 lockstep_seen;              // time it was read
+
+static bool LS_Init(void)
+{
+    lockstep_map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                      0, sizeof(lockstep_t), LOCKSTEP_NAME);
+    if (!lockstep_map)
+    {
+        SDL_Log("CreateFileMapping failed: %lu", GetLastError());
+        return false;
+    }
+
+    // First process to create the block leads
+    lockstep_leader = (GetLastError() != ERROR_ALREADY_EXISTS);
+
+    lockstep = MapViewOfFile(lockstep_map, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(lockstep_t));
+    if (!lockstep)
+    {
+        SDL_Log("MapViewOfFile failed: %lu", GetLastError());
+        CloseHandle(lockstep_map);
+        lockstep_map = NULL;
+        return false;
+    }
+
+    if (lockstep_leader)
+        InterlockedExchange(&lockstep->leader, (LONG)GetCurrentProcessId());
+
+    lockstep_seen = SDL_GetTicks();
+    return true;
+}
+
+static void LS_Shutdown(void)
+{
+    if (lockstep)
+        UnmapViewOfFile(lockstep);
+    if (lockstep_map)
+        CloseHandle(lockstep_map);
+    lockstep = NULL;
+    lockstep_map = NULL;
+}
+
+static void LS_Publish(uint32_t seed, int w, int h)
+{
+    lockstep->seed = seed;
+    lockstep->field_w = w;
+    lockstep->field_h = h;
+    InterlockedExchange(&lockstep->ready, 1); // full barrier
+}
+
+static bool LS_Join(uint32_t *seed, int *w, int *h)
+{
+    const Uint64 start = SDL_GetTicks();
+
+    while (!InterlockedCompareExchange(&lockstep->ready, 0, 0))
+    {
+        if (SDL_GetTicks() - start > 10000)
+        {
+            SDL_Log("Lockstep: no leader");
+            return false;
+        }
+        SDL_Delay(10);
+    }
+
+    *seed = lockstep->seed;
+    *w = lockstep->field_w;
+    *h = lockstep->field_h;
+    return true;
+}
+
+//
+// A leader that stalled for too long (a window drag blocks the message
+// loop) may have been replaced meanwhile; it follows from then on.
+//
+
+static void LS_PublishTic(Uint64 tic)
+{
+    if (InterlockedCompareExchange(&lockstep->leader, 0, 0) != (LONG)GetCurrentProcessId())
+    {
+        lockstep_leader = false;
+        lockstep_tic = (Uint64)InterlockedCompareExchange64(&lockstep->gametic, 0, 0);
+        lockstep_seen = SDL_GetTicks();
+        SDL_Log("Lockstep: another process leads now, following it");
+        return;
+    }
+
+    InterlockedExchange64(&lockstep->gametic, (LONG64)tic);
+}
+
+//
+// Followers read the leader's tic. If it stops moving for a while, the
+// leader is gone and the first follower to notice carries on the clock.
+//
+
+static Uint64 LS_ReadTic(void)
+{
+    const Uint64 tic = (Uint64)InterlockedCompareExchange64(&lockstep->gametic, 0, 0);
+    const Uint64 now = SDL_GetTicks();
+
+    if (tic != lockstep_tic)
+    {
+        lockstep_tic = tic;
+        lockstep_seen = now;
+    }
+    else if (now - lockstep_seen > LOCKSTEP_TAKEOVER_MS)
+    {
+        const LONG old = InterlockedCompareExchange(&lockstep->leader, 0, 0);
+        const LONG me = (LONG)GetCurrentProcessId();
+
+        if (InterlockedCompareExchange(&lockstep->leader, me, old) == old)
+        {
+            lockstep_leader = true;
+            last_tic_time = now;
+        }
+        lockstep_seen = now;
+    }
+
+    return tic;
+}
+
+//
+// -locksteptest N: runs N headless lockstep processes of this program
+// with -framehash, each writing to a file of its own, then compares
+// their hashes tic by tic. The first one started leads.
+//
+
+#define LOCKSTEP_TEST_MAX 16
+
+static int LS_RunTest(int n, int tics)
+{
+    PROCESS_INFORMATION pi[LOCKSTEP_TEST_MAX];
+    char paths[LOCKSTEP_TEST_MAX][MAX_PATH + 32];
+    char logs[LOCKSTEP_TEST_MAX][MAX_PATH + 32];
+    char exe[MAX_PATH], tmp[MAX_PATH];
+    uint64_t *hashes;
+    int started = 0, failed = 0;
+
+    n = BETWEEN(2, LOCKSTEP_TEST_MAX, n);
+    if (!GetModuleFileNameA(NULL, exe, sizeof(exe)) || !GetTempPathA(sizeof(tmp), tmp))
+        return 1;
+
+    hashes = calloc((size_t)n * (tics + 1), sizeof(*hashes));
+    if (!hashes)
+        return 1;
+
+    for (int i = 0; i < n; i++)
+    {
+        SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };   // children inherit the file
+        STARTUPINFOA si = { .cb = sizeof(si), .dwFlags = STARTF_USESTDHANDLES };
+        char cmd[MAX_PATH + 64];
+
+        snprintf(paths[i], sizeof(paths[i]), "%sstars_lockstep%d.txt", tmp, i);
+        snprintf(logs[i], sizeof(logs[i]), "%sstars_lockstep%d.log", tmp, i);
+        snprintf(cmd, sizeof(cmd), "\"%s\" -headless -lockstep -framehash -tics %d", exe, tics);
+
+        // Hashes and log lines in files of their own: stdout is fully
+        // buffered, a shared handle could get a log line mid hash line
+        si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        si.hStdOutput = CreateFileA(paths[i], GENERIC_WRITE, FILE_SHARE_READ, &sa,
+                                    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        si.hStdError = CreateFileA(logs[i], GENERIC_WRITE, FILE_SHARE_READ, &sa,
+                                   CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (si.hStdOutput == INVALID_HANDLE_VALUE || si.hStdError == INVALID_HANDLE_VALUE)
+        {
+            if (si.hStdOutput != INVALID_HANDLE_VALUE)
+                CloseHandle(si.hStdOutput);
+            if (si.hStdError != INVALID_HANDLE_VALUE)
+                CloseHandle(si.hStdError);
+            break;
+        }
+
+        const BOOL ok = CreateProcessA(NULL, cmd, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi[i]);
+        CloseHandle(si.hStdOutput);
+        CloseHandle(si.hStdError);
+        if (!ok)
+        {
+            printf("locksteptest: CreateProcess failed: %lu\n", GetLastError());
+            break;
+        }
+        started++;
+
+        // The leader creates the shared block before anyone else opens it
+        if (i == 0)
+            Sleep(500);
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        DWORD code = 1;
+
+        WaitForSingleObject(pi[i].hProcess, INFINITE);
+        GetExitCodeProcess(pi[i].hProcess, &code);
+        CloseHandle(pi[i].hProcess);
+        CloseHandle(pi[i].hThread);
+        failed += code != 0;
+    }
+
+    // Lines are "tic N hash H", anything else in the output is skipped;
+    // bit 32 marks the tics a process reported
+    int missing = 0, mismatch = 0;
+
+    for (int i = 0; i < started; i++)
+    {
+        FILE *f = fopen(paths[i], "r");
+        char line[128];
+        unsigned long long tic;
+        unsigned hash;
+
+        while (f && fgets(line, sizeof(line), f))
+        {
+            if (sscanf(line, "tic %llu hash %x", &tic, &hash) == 2 && tic >= 1 && tic <= (unsigned long long)tics)
+                hashes[(size_t)i * (tics + 1) + tic] = hash | 1ull << 32;
+        }
+        if (f)
+            fclose(f);
+        DeleteFileA(paths[i]);
+    }
+
+    for (int t = 1; t <= tics; t++)
+    {
+        const uint64_t first = hashes[t];
+
+        for (int i = 0; i < started; i++)
+        {
+            const uint64_t h = hashes[(size_t)i * (tics + 1) + t];
+
+            if (!h)
+                missing++;
+            else if (first && h != first && mismatch++ == 0)
+                printf("locksteptest: tic %d: process 0 has %08x, process %d has %08x\n",
+                       t, (unsigned)first, i, (unsigned)h);
+        }
+    }
+
+    printf("locksteptest: %d of %d processes, %d tics: %d mismatched, %d missing, %d failed\n",
+           started, n, tics, mismatch, missing, failed);
+
+    // The children's logs are kept when something went wrong
+    const bool passed = started == n && !mismatch && !missing && !failed;
+
+    for (int i = 0; i < started; i++)
+    {
+        if (passed)
+            DeleteFileA(logs[i]);
+        else
+            printf("locksteptest: process %d log: %s\n", i, logs[i]);
+    }
+
+    free(hashes);
+    return passed ? 0 : 1;
+}
 
 
 // -----------------------------------------------------------------------------
@@ -116,12 +515,27 @@ static int SHOW_FPS         = 0;     // 1 = show fps counter
 static void I_Ticker (void)
 {
     const Uint64 now = SDL_GetTicks();
+    Uint64 elapsed_ticks = 0;
 
-    if (now - last_tic_time >= TIC_DURATION_MS)
+    if (lockstep && !lockstep_leader)
     {
-        const Uint64 elapsed_ticks = (now - last_tic_time) / TIC_DURATION_MS;
-        gametic += elapsed_ticks;
+        // Followers take the clock from the leader
+        const Uint64 tic = LS_ReadTic();
+        if (tic > gametic)
+            elapsed_ticks = tic - gametic;
+    }
+    else if (now - last_tic_time >= TIC_DURATION_MS)
+    {
+        elapsed_ticks = (now - last_tic_time) / TIC_DURATION_MS;
         last_tic_time += elapsed_ticks * TIC_DURATION_MS;
+    }
+
+    if (elapsed_ticks)
+    {
+        gametic += elapsed_ticks;
+
+        if (lockstep && lockstep_leader)
+            LS_PublishTic(gametic);
 
         // Handle message timeout and fading
         if (msg_timeout)
@@ -154,6 +568,27 @@ static bool M_CheckParm(const char *parm, int argc, char **argv)
     return false;
 }
 
+//
+// Value that follows a command line parameter, or the default
+//
+
+static int M_ParmValue(const char *parm, int def, int argc, char **argv)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], parm) == 0)
+        {
+            char *end;
+            const long value = strtol(argv[i + 1], &end, 10);
+
+            // Not a number (another option follows): the default
+            return end != argv[i + 1] && !*end ? (int)value : def;
+        }
+    }
+
+    return def;
+}
+
 //
 // Our RNG/LCG function (Linear Congruential Generator) from International Doom.
 //
@@ -163,6 +598,84 @@ int M_RealRandom(void)
     return (m_rand_seed = m_rand_seed * 214013u + 2531011u) >> 17;
 }
 
+// Same generator over a private state, for other threads
+static int M_RandomFrom(uint32_t *seed)
+{
+    return (*seed = *seed * 214013u + 2531011u) >> 17;
+}
+
+//
+// Counter-based RNG: the n-th random number (0..32767, like M_RealRandom)
+// of a star's generation, computed from scratch with a SplitMix64 finalizer.
+//
+
+static int M_CounterRandom(uint32_t seed, uint32_t index, uint32_t gen, uint32_t n)
+{
+    uint64_t z = (uint64_t)seed * 0x9e3779b97f4a7c15ull
+               + (uint64_t)index * 0xbf58476d1ce4e5b9ull
+               + (uint64_t)gen * 0x94d049bb133111ebull + n;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return (int)(z >> 49);
+}
+
+//
+// Smooth value noise (0..1) for procedural effects. Stateless, so it
+// doesn't disturb the M_RealRandom sequence.
+//
+
+static float M_HashFloat(int32_t n)
+{
+    uint32_t h = (uint32_t)n * 0x27d4eb2du;
+    h ^= h >> 15;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return (float)(h & 0xffffff) / (float)0xffffff;
+}
+
+static float M_Noise1D(float x)
+{
+    const float   fl = floorf(x);
+    const float   f  = x - fl;
+    const float   u  = f * f * (3.0f - 2.0f * f);
+    const int32_t i  = (int32_t)fl;
+    const float   a  = M_HashFloat(i);
+
+    return a + (M_HashFloat(i + 1) - a) * u;
+}
+
+static float M_Noise2D(float x, float y)
+{
+    const float   flx = floorf(x), fly = floorf(y);
+    const float   fx = x - flx, fy = y - fly;
+    const float   u = fx * fx * (3.0f - 2.0f * fx);
+    const float   v = fy * fy * (3.0f - 2.0f * fy);
+    const int32_t i = (int32_t)flx, j = (int32_t)fly;
+    #define CORNER(a, b) M_HashFloat((int32_t)((uint32_t)(i + (a)) * 1619u + (uint32_t)(j + (b)) * 31337u))
+    const float   top = CORNER(0, 0) + (CORNER(1, 0) - CORNER(0, 0)) * u;
+    const float   bot = CORNER(0, 1) + (CORNER(1, 1) - CORNER(0, 1)) * u;
+    #undef CORNER
+
+    return top + (bot - top) * v;
+}
+
+static float M_FractalNoise1D(float x, int octaves)
+{
+    float sum = 0, amp = 0.5f, norm = 0;
+
+    for (int i = 0; i < octaves; i++)
+    {
+        sum += M_Noise1D(x) * amp;
+        norm += amp;
+        x = x * 2.03f + 17.0f;
+        amp *= 0.5f;
+    }
+
+    return sum / norm;
+}
+
 
 // -----------------------------------------------------------------------------
 // Confing file handling and INI helpers
@@ -197,8 +710,35 @@ static void ini_apply_kv(const char *key, const char *val)
     else if (ieq(key, "brightness_step")) BRIGHTNESS_STEP = (int)strtol(val, NULL, 10);
     else if (ieq(key, "colored_stars"))   COLORED_STARS   = (int)strtol(val, NULL, 10);
     else if (ieq(key, "star_size"))       STAR_SIZE       = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "size_dist"))       SIZE_DIST       = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "size_falloff"))    SIZE_FALLOFF    = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "shape_disc_min"))   SHAPE_DISC_MIN   = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "shape_cross_min"))  SHAPE_CROSS_MIN  = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "shape_spikes_min")) SHAPE_SPIKES_MIN = (int)strtol(val, NULL, 10);
     else if (ieq(key, "star_speed"))      STAR_SPEED      = (int)strtol(val, NULL, 10);
     else if (ieq(key, "show_fps"))        SHOW_FPS        = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "aurora"))          AURORA          = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "flow_field"))      FLOW_FIELD      = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "flow_grid"))       FLOW_GRID       = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "flow_evolve"))     FLOW_EVOLVE     = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "counter_rng"))     COUNTER_RNG     = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "respawn_ring"))    RESPAWN_RING    = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "span_displays"))   SPAN_DISPLAYS   = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "bezel_gap"))       BEZEL_GAP       = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "render_scale"))    RENDER_SCALE    = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "static_cache"))    STATIC_CACHE    = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "panorama"))        PANORAMA        = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "panorama_drift"))  PANORAMA_DRIFT  = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "job_threads"))     JOB_THREADS     = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "motion_blur"))     MOTION_BLUR     = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "scene_fade_ms"))   SCENE_FADE_MS   = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "scene") && num_scenes < MAXSCENES)
+        snprintf(scenes[num_scenes++].text, sizeof(scenes[0].text), "%s", val);
+    else if (ieq(key, "power_profiles"))  POWER_PROFILES  = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "battery_delay_ms")) BATTERY_DELAY_MS = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "battery_stars"))   BATTERY_STARS   = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "battery_effects")) BATTERY_EFFECTS = (int)strtol(val, NULL, 10);
+    else if (ieq(key, "battery_scale"))   BATTERY_SCALE   = (int)strtol(val, NULL, 10);
 }
 
 static int CFG_Load(const char *path)
@@ -229,11 +769,36 @@ static void CFG_Check(void)
     FULLSCREEN      = BETWEEN(0, 1,        FULLSCREEN);
     NUM_STARS       = BETWEEN(0, MAXSTARS, NUM_STARS);
     DELAY_MS        = BETWEEN(0, 1000,     DELAY_MS);
-    BRIGHTNESS_STEP = BETWEEN(1, 255,      BRIGHTNESS_STEP);
+    BRIGHTNESS_STEP = BETWEEN(0, 255,      BRIGHTNESS_STEP);
     COLORED_STARS   = BETWEEN(0, 1,        COLORED_STARS);
-    STAR_SIZE       = BETWEEN(1, 16,       STAR_SIZE);
+    STAR_SIZE       = BETWEEN(1, MAXSIZE,  STAR_SIZE);
+    SIZE_DIST       = BETWEEN(0, 1,        SIZE_DIST);
+    SIZE_FALLOFF    = BETWEEN(10, 90,      SIZE_FALLOFF);
+    SHAPE_DISC_MIN  = BETWEEN(0, 256,      SHAPE_DISC_MIN);
+    SHAPE_CROSS_MIN = BETWEEN(0, 256,      SHAPE_CROSS_MIN);
+    SHAPE_SPIKES_MIN = BETWEEN(0, 256,     SHAPE_SPIKES_MIN);
     STAR_SPEED      = BETWEEN(-10, 10,     STAR_SPEED);
     SHOW_FPS        = BETWEEN(0, 1,        SHOW_FPS);
+    AURORA          = BETWEEN(0, 1,        AURORA);
+    FLOW_FIELD      = BETWEEN(0, 1,        FLOW_FIELD);
+    FLOW_GRID       = BETWEEN(4, 256,      FLOW_GRID);
+    FLOW_EVOLVE     = BETWEEN(0, 100,      FLOW_EVOLVE);
+    COUNTER_RNG     = BETWEEN(0, 1,        COUNTER_RNG);
+    RESPAWN_RING    = BETWEEN(0, 1,        RESPAWN_RING);
+    SPAN_DISPLAYS   = BETWEEN(0, 1,        SPAN_DISPLAYS);
+    BEZEL_GAP       = BETWEEN(0, 1000,     BEZEL_GAP);
+    RENDER_SCALE    = BETWEEN(25, 100,     RENDER_SCALE);
+    STATIC_CACHE    = BETWEEN(0, 1,        STATIC_CACHE);
+    PANORAMA        = BETWEEN(0, 1,        PANORAMA);
+    PANORAMA_DRIFT  = BETWEEN(-100, 100,   PANORAMA_DRIFT);
+    JOB_THREADS     = BETWEEN(-1, 15,      JOB_THREADS);
+    MOTION_BLUR     = BETWEEN(0, 1,        MOTION_BLUR);
+    SCENE_FADE_MS   = BETWEEN(0, 60000,    SCENE_FADE_MS);
+    POWER_PROFILES  = BETWEEN(0, 1,        POWER_PROFILES);
+    BATTERY_DELAY_MS = BETWEEN(0, 1000,    BATTERY_DELAY_MS);
+    BATTERY_STARS   = BETWEEN(0, MAXSTARS, BATTERY_STARS);
+    BATTERY_EFFECTS = BETWEEN(0, 1,        BATTERY_EFFECTS);
+    BATTERY_SCALE   = BETWEEN(25, 100,     BATTERY_SCALE);
 }
 
 static int CFG_Save(const char *path)
@@ -246,214 +811,4965 @@ static int CFG_Save(const char *path)
     fprintf(f, "num_stars %d\n",       NUM_STARS);
     fprintf(f, "\n# Delay between frames in milliseconds. Affects animation speed. (0...1000)\n");
     fprintf(f, "delay_ms %d\n",        DELAY_MS);
-    fprintf(f, "\n# Step by which brightness decreases. Affects fading smoothness. (1...255)\n");
+    fprintf(f, "\n# Step by which brightness decreases. Affects fading smoothness. (0 = no fading, 1...255)\n");
     fprintf(f, "brightness_step %d\n", BRIGHTNESS_STEP);
     fprintf(f, "\n# Use colored stars. (0 = grayscale, 1 = colored)\n");
     fprintf(f, "colored_stars %d\n",   COLORED_STARS);
     fprintf(f, "\n# Define star size. (1...16)\n");
     fprintf(f, "star_size %d\n",       STAR_SIZE);
+    fprintf(f, "\n# Vary star sizes from 1 up to star_size, small stars being more common.");
+    fprintf(f, "\n# (0 = all stars of star_size, 1 = varied)\n");
+    fprintf(f, "size_dist %d\n",       SIZE_DIST);
+    fprintf(f, "\n# Percentage of stars in each size compared to the size below. (10...90)\n");
+    fprintf(f, "size_falloff %d\n",    SIZE_FALLOFF);
+    fprintf(f, "\n# Star shapes by brightness: stars at least this bright are drawn as");
+    fprintf(f, "\n# discs, crosses or with diffraction spikes, the brightest shape wins.");
+    fprintf(f, "\n# Dimmer stars are squares. (0...255, 256 = never)\n");
+    fprintf(f, "shape_disc_min %d\n",   SHAPE_DISC_MIN);
+    fprintf(f, "shape_cross_min %d\n",  SHAPE_CROSS_MIN);
+    fprintf(f, "shape_spikes_min %d\n", SHAPE_SPIKES_MIN);
     fprintf(f, "\n# Movement speed and direction (-10...0...10).");
     fprintf(f, "\n# Negative = moving left, zero = static, positive = moving right.\n");
     fprintf(f, "star_speed %d\n", STAR_SPEED);
     fprintf(f, "\n# Show FPS counter (0 = no, 1 = yes).\n");
     fprintf(f, "show_fps %d\n", SHOW_FPS);
+    fprintf(f, "\n# Draw aurora curtains behind the stars (0 = no, 1 = yes).\n");
+    fprintf(f, "aurora %d\n", AURORA);
+    fprintf(f, "\n# Drift along a swirling flow field instead of a straight line (0 = no, 1 = yes).");
+    fprintf(f, "\n# Not used with counter_rng.\n");
+    fprintf(f, "flow_field %d\n", FLOW_FIELD);
+    fprintf(f, "\n# Flow field grid cells across the screen. (4...256)\n");
+    fprintf(f, "flow_grid %d\n", FLOW_GRID);
+    fprintf(f, "\n# How fast the flow field changes. (0...100)\n");
+    fprintf(f, "flow_evolve %d\n", FLOW_EVOLVE);
+    fprintf(f, "\n# Derive every star from its own counter-based RNG (0 = no, 1 = yes).");
+    fprintf(f, "\n# Makes the field seekable to any tic and independent of update order.\n");
+    fprintf(f, "counter_rng %d\n", COUNTER_RNG);
+    fprintf(f, "\n# Prepare respawned stars on a background thread (0 = no, 1 = yes).\n");
+    fprintf(f, "respawn_ring %d\n", RESPAWN_RING);
+    fprintf(f, "\n# Span one star field across all displays (0 = no, 1 = yes).\n");
+    fprintf(f, "span_displays %d\n", SPAN_DISPLAYS);
+    fprintf(f, "\n# Pixels hidden behind the bezels between spanned displays. (0...1000)\n");
+    fprintf(f, "bezel_gap %d\n", BEZEL_GAP);
+    fprintf(f, "\n# Star field resolution in percent of the window. (25...100)\n");
+    fprintf(f, "render_scale %d\n", RENDER_SCALE);
+    fprintf(f, "\n# Reuse the last frame while the sky doesn't change (0 = no, 1 = yes).\n");
+    fprintf(f, "static_cache %d\n", STATIC_CACHE);
+    fprintf(f, "\n# Draw the panorama.sky tile file behind the stars (0 = no, 1 = yes).\n");
+    fprintf(f, "panorama %d\n", PANORAMA);
+    fprintf(f, "\n# Panorama scroll speed, 1/10 pixel per tic. (-100...100)\n");
+    fprintf(f, "panorama_drift %d\n", PANORAMA_DRIFT);
+    fprintf(f, "\n# Job worker threads for parallel updates (-1 = none, 0 = one per core, 1...15)\n");
+    fprintf(f, "job_threads %d\n", JOB_THREADS);
+    fprintf(f, "\n# Draw moving stars as streaks along their motion (0 = no, 1 = yes).\n");
+    fprintf(f, "motion_blur %d\n", MOTION_BLUR);
+    fprintf(f, "\n# Switch to the battery profile below when unplugged (0 = no, 1 = yes).\n");
+    fprintf(f, "power_profiles %d\n", POWER_PROFILES);
+    fprintf(f, "\n# Battery profile: delay between frames. (0...1000)\n");
+    fprintf(f, "battery_delay_ms %d\n", BATTERY_DELAY_MS);
+    fprintf(f, "\n# Battery profile: number of stars. (0...500)\n");
+    fprintf(f, "battery_stars %d\n", BATTERY_STARS);
+    fprintf(f, "\n# Battery profile: keep aurora and flow field (0 = no, 1 = yes).\n");
+    fprintf(f, "battery_effects %d\n", BATTERY_EFFECTS);
+    fprintf(f, "\n# Battery profile: render scale in percent. (25...100)\n");
+    fprintf(f, "battery_scale %d\n", BATTERY_SCALE);
+    fprintf(f, "\n# Scene playlist: one line per scene, seconds to show it and then the\n");
+    fprintf(f, "# settings that differ from the ones above, e.g.\n");
+    fprintf(f, "# scene 60 num_stars=300 star_speed=-6 colored_stars=0 aurora=1\n");
+    fprintf(f, "# Scenes can set num_stars, brightness_step, colored_stars, star_speed,\n");
+    fprintf(f, "# star_size, size_dist, size_falloff, shape_*_min, aurora and motion_blur.\n");
+    for (int i = 0; i < num_scenes; i++)
+        fprintf(f, "scene %s\n", scenes[i].text);
+    fprintf(f, "\n# Crossfade between scenes in milliseconds. (0...60000)\n");
+    fprintf(f, "scene_fade_ms %d\n", SCENE_FADE_MS);
     fclose(f);
     return 1;
 }
 
-
 // -----------------------------------------------------------------------------
-// Renderer
+// Logging: every thread writes binary records into its own ring, a flusher
+// thread formats and prints them, so the frame path never waits for I/O
 // -----------------------------------------------------------------------------
 
-static void R_RandomizeStarColor(short *r, short *g, short *b)
-{
-    if (COLORED_STARS)
-    {
-        *r = (short)(M_RealRandom() % 256);
-        *g = (short)(M_RealRandom() % 256);
-        *b = (short)(M_RealRandom() % 256);
-    }
-    else
-    {
-        short gray = (short)(M_RealRandom() % 256);
-        *r = *g = *b = gray;
-    }
-}
+#define LOG_THREADS 8                     // rings, one per logging thread
+#define LOG_RING 256                      // records per ring, power of two
+#define LOG_ARGS 8
+#define LOG_TEXT 48                       // room for copied %s arguments
+#define LOG_FLUSH_MS 1000                 // flusher's fallback wake, see LOG_Printf
+#define LOG_RATE_SLOTS 16
+#define LOG_BURST 5                       // same message this often...
+#define LOG_RATE_NS 1000000000ull         // ...per second, then suppressed
 
-static void R_InitStars(int count, int maxx, int maxy)
+typedef union
 {
-    if (maxx <= 0 || maxy <= 0) return;
+    long long i;
+    unsigned long long u;                 // %u %o %x %X, not sign extended
+    double d;
+    const void *p;
+} log_arg_t;
 
-    for (int i = 0; i < count; i++)
-    {
-        stars[i].x = (float)(M_RealRandom() % maxx);
-        stars[i].y = (float)(M_RealRandom() % maxy);
-        stars[i].speed = 0.5f + ((M_RealRandom() % 100) / 100.0f);
-        stars[i].brightness = M_RealRandom() % 256;
-        R_RandomizeStarColor(&stars[i].r, &stars[i].g, &stars[i].b);
-    }
-}
+typedef struct
+{
+    Uint64 time;                          // SDL_GetTicksNS
+    const char *fmt;                      // must be a literal, read later
+    int suppressed;                       // repeats dropped before this one
+    log_arg_t args[LOG_ARGS];
+    char text[LOG_TEXT];                  // %s arguments, back to back
+} log_record_t;
 
-static void R_UpdateStars(int count, int maxx, int maxy)
+typedef struct
 {
-    if (maxx <= 0 || maxy <= 0) return;
+    const char *fmt;
+    Uint64 window;                        // start of the current second
+    int count;
+    int suppressed;
+} log_rate_t;
 
-    for (int i = 0; i < count; i++)
-    {
-        // Movement: global speed * star-specific coefficient / fine-tuning
-        stars[i].x += ((float)STAR_SPEED * stars[i].speed) / 6;
+typedef struct
+{
+    SDL_AtomicInt owned;                  // claimed by a live thread
+    SDL_AtomicInt head;                   // written by the owner
+    SDL_AtomicInt tail;                   // written by the flusher
+    SDL_AtomicInt dropped;                // ring was full
+    log_rate_t rate[LOG_RATE_SLOTS];      // owner only
+    log_record_t records[LOG_RING];
+} log_ring_t;
 
-        // Brightness logics
-        if (stars[i].brightness > 0)
-        {
-            stars[i].brightness -= BRIGHTNESS_STEP;
-            if (stars[i].brightness < 0)
-                stars[i].brightness = 0;
-        }
+static log_ring_t log_rings[LOG_THREADS];
+static SDL_TLSID log_tls;
+static SDL_AtomicInt log_lost;            // no ring free for the thread
+static SDL_Thread *log_thread;
+static SDL_Semaphore *log_wake;           // a ring got its first record
+static SDL_AtomicInt log_quit;
 
-        // Check for leaving screen bounds (on both sides) and fading out
-        const bool out_right = (STAR_SPEED > 0 && stars[i].x > (float)maxx);
-        const bool out_left  = (STAR_SPEED < 0 && stars[i].x < 0);
-        
-        if (out_right || out_left || stars[i].brightness <= 0)
-        {
-            // Respawn on the opposite side or at a random position
-            if (out_right)
-            {
-                stars[i].x = 0;
-            }
-            else if (out_left)
-            {
-                stars[i].x = (float)maxx;
-            }
-            else
-            {
-                stars[i].x = (float)(M_RealRandom() % maxx);
-            }
-            stars[i].y = (float)(M_RealRandom() % maxy);
-            stars[i].speed = 0.5f + ((M_RealRandom() % 100) / 100.0f);
-            stars[i].brightness = 128 + (M_RealRandom() % 128); 
-            R_RandomizeStarColor(&stars[i].r, &stars[i].g, &stars[i].b);
-        }
-    }
+static void SDLCALL LOG_ReleaseRing(void *ring)
+{
+    SDL_SetAtomicInt(&((log_ring_t *)ring)->owned, 0);
 }
 
-static void R_DrawStars(int count)
+static log_ring_t *LOG_GetRing(void)
 {
-    // Clear to black once per frame (SDL renderer is a backbuffer)
-    SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, 255);
-    SDL_RenderClear(sdl_renderer);
+    log_ring_t *ring = SDL_GetTLS(&log_tls);
 
-    for (int i = 0; i < count; i++)
+    if (ring)
+        return ring;
+
+    // A ring left by a finished thread is reused once the flusher drained it
+    for (int i = 0; i < LOG_THREADS; i++)
     {
-        const int br = BETWEEN(0, 255, stars[i].brightness);
+        ring = &log_rings[i];
 
-        Uint8 rr, gg, bb;
-        if (COLORED_STARS)
+        if (SDL_GetAtomicInt(&ring->head) == SDL_GetAtomicInt(&ring->tail)
+        &&  SDL_CompareAndSwapAtomicInt(&ring->owned, 0, 1))
         {
-            // scale base color by brightness
-            rr = (Uint8)((stars[i].r * br) / 255);
-            gg = (Uint8)((stars[i].g * br) / 255);
-            bb = (Uint8)((stars[i].b * br) / 255);
-        }
-        else
-        {
-            rr = gg = bb = (Uint8)br;
+            memset(ring->rate, 0, sizeof(ring->rate));
+            SDL_SetTLS(&log_tls, ring, LOG_ReleaseRing);
+            return ring;
         }
+    }
 
-        SDL_SetRenderDrawColor(sdl_renderer, rr, gg, bb, 255);
+    return NULL;
+}
+
+//
+// Returns false when fmt was logged LOG_BURST times in the last second.
+//
+
+//
+// Hand the record at head to the flusher. It is woken when the ring was
+// empty; it drains until nothing is left before it sleeps, so later
+// records are picked up without this.
+//
+
+static void LOG_Publish(log_ring_t *ring, int head)
+{
+    SDL_SetAtomicInt(&ring->head, head + 1);
+
+    if (log_wake && SDL_GetAtomicInt(&ring->tail) == head)
+        SDL_SignalSemaphore(log_wake);
+}
+
+// A rate slot taken over by another message reports its pending count in
+// a record of its own, the old format shown as text
+static void LOG_PutSuppressed(log_ring_t *ring, const char *fmt, int count, Uint64 now)
+{
+    const int head = SDL_GetAtomicInt(&ring->head);
+
+    if (head - SDL_GetAtomicInt(&ring->tail) >= LOG_RING)
+    {
+        SDL_AddAtomicInt(&ring->dropped, 1);
+        return;
+    }
+
+    log_record_t *rec = &ring->records[head & (LOG_RING - 1)];
+    const size_t len = MIN(strlen(fmt), (size_t)(LOG_TEXT - 1));
+
+    rec->time = now;
+    rec->fmt = "Rate limit: \"%s\"";
+    rec->suppressed = count;
+    memcpy(rec->text, fmt, len);
+    rec->text[len] = '\0';
+    rec->args[0].i = 0;
+    LOG_Publish(ring, head);
+}
+
+static bool LOG_RateCheck(log_ring_t *ring, const char *fmt, Uint64 now, int *suppressed)
+{
+    log_rate_t *r = &ring->rate[((uintptr_t)fmt >> 3) % LOG_RATE_SLOTS];
+
+    if (r->fmt != fmt || now - r->window >= LOG_RATE_NS)
+    {
+        // Another message hashed here: flush the old one's count first
+        if (r->fmt && r->fmt != fmt && r->suppressed)
+            LOG_PutSuppressed(ring, r->fmt, r->suppressed, now);
+
+        *suppressed = r->fmt == fmt ? r->suppressed : 0;
+        r->fmt = fmt;
+        r->window = now;
+        r->count = 1;
+        r->suppressed = 0;
+        return true;
+    }
+
+    if (r->count >= LOG_BURST)
+    {
+        r->suppressed++;
+        return false;
+    }
+
+    r->count++;
+    *suppressed = 0;
+    return true;
+}
+
+//
+// Store fmt and its raw arguments, printf-style. Only the conversion
+// letters are looked at here; flags, width and precision are applied by
+// the flusher. %s arguments are copied (and may be truncated), everything
+// else is kept by value.
+//
+
+static void LOG_Printf(const char *fmt, ...)
+{
+    log_ring_t *ring = LOG_GetRing();
+    const Uint64 now = SDL_GetTicksNS();
+    int suppressed = 0;
+
+    if (!ring)
+    {
+        SDL_AddAtomicInt(&log_lost, 1);
+        return;
+    }
+
+    if (!LOG_RateCheck(ring, fmt, now, &suppressed))
+        return;
+
+    const int head = SDL_GetAtomicInt(&ring->head);
+
+    if (head - SDL_GetAtomicInt(&ring->tail) >= LOG_RING)
+    {
+        SDL_AddAtomicInt(&ring->dropped, 1);
+        return;
+    }
+
+    log_record_t *rec = &ring->records[head & (LOG_RING - 1)];
+    int nargs = 0, text = 0;
+    va_list ap;
+
+    rec->time = now;
+    rec->fmt = fmt;
+    rec->suppressed = suppressed;
+
+    va_start(ap, fmt);
+    for (const char *c = fmt; *c && nargs < LOG_ARGS; c++)
+    {
+        if (*c != '%' || *++c == '%')
+            continue;
+
+        int longs = 0;
+
+        for (; *c && !strchr("diouxXcfFeEgGsp", *c); c++)
+        {
+            if (*c == 'l' || *c == 'z')
+                longs += (*c == 'z') ? 2 : 1;
+        }
+
+        switch (*c)
+        {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                rec->args[nargs++].d = va_arg(ap, double);
+                break;
+
+            case 's':
+            {
+                const char *str = va_arg(ap, const char *);
+                const size_t len = MIN(strlen(str ? str : "(null)"), (size_t)(LOG_TEXT - 1 - text));
+
+                memcpy(rec->text + text, str ? str : "(null)", len);
+                rec->text[text + len] = '\0';
+                rec->args[nargs++].i = text;
+                text = MIN(text + (int)len + 1, LOG_TEXT - 1);
+                break;
+            }
+
+            case 'p':
+                rec->args[nargs++].p = va_arg(ap, const void *);
+                break;
+
+            case '\0':
+                c--;
+                break;
+
+            case 'u': case 'o': case 'x': case 'X':
+                rec->args[nargs++].u = longs >= 2 ? va_arg(ap, unsigned long long)
+                                     : longs == 1 ? va_arg(ap, unsigned long)
+                                     : va_arg(ap, unsigned int);
+                break;
+
+            default:
+                rec->args[nargs++].i = longs >= 2 ? va_arg(ap, long long)
+                                     : longs == 1 ? va_arg(ap, long)
+                                     : va_arg(ap, int);
+                break;
+        }
+    }
+    va_end(ap);
+
+    LOG_Publish(ring, head);
+}
+
+//
+// Rebuild the line: every conversion is printed on its own with the
+// caller's flags and width, its length modifier replaced by the stored type.
+//
+
+static void LOG_Format(const log_record_t *rec, char *out, size_t size)
+{
+    size_t len = snprintf(out, size, "[%8.3f] ", rec->time / 1e9);
+    int nargs = 0;
+
+    for (const char *c = rec->fmt; *c && len < size - 1; c++)
+    {
+        if (*c != '%')
+        {
+            out[len++] = *c;
+            continue;
+        }
+
+        if (c[1] == '%')
+        {
+            out[len++] = *++c;
+            continue;
+        }
+
+        char spec[24] = "%";
+        size_t n = 1;
+
+        for (c++; *c && !strchr("diouxXcfFeEgGsp", *c); c++)
+        {
+            if (!strchr("hlzjt", *c) && n < sizeof(spec) - 4)
+                spec[n++] = *c;
+        }
+
+        if (!*c || nargs >= LOG_ARGS)
+            break;
+
+        const log_arg_t *arg = &rec->args[nargs++];
+        const size_t room = size - len;
+
+        switch (*c)
+        {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                spec[n] = *c;
+                len += snprintf(out + len, room, spec, arg->d);
+                break;
+
+            case 's':
+                spec[n] = 's';
+                len += snprintf(out + len, room, spec, rec->text + arg->i);
+                break;
+
+            case 'p':
+                spec[n] = 'p';
+                len += snprintf(out + len, room, spec, arg->p);
+                break;
+
+            case 'c':
+                spec[n] = 'c';
+                len += snprintf(out + len, room, spec, (int)arg->i);
+                break;
+
+            case 'u': case 'o': case 'x': case 'X':
+                spec[n] = 'l';
+                spec[n + 1] = 'l';
+                spec[n + 2] = *c;
+                len += snprintf(out + len, room, spec, arg->u);
+                break;
+
+            default:
+                spec[n] = 'l';
+                spec[n + 1] = 'l';
+                spec[n + 2] = *c;
+                len += snprintf(out + len, room, spec, arg->i);
+                break;
+        }
+    }
+
+    len = MIN(len, size - 1);
+
+    if (rec->suppressed)
+        len += snprintf(out + len, size - len, " (%d similar suppressed)", rec->suppressed);
+
+    len = MIN(len, size - 2);
+    out[len++] = '\n';
+    out[len] = '\0';
+}
+
+static bool LOG_Drain(void)
+{
+    bool any = false;
+    char line[256];
+
+    for (int i = 0; i < LOG_THREADS; i++)
+    {
+        log_ring_t *ring = &log_rings[i];
+        const int head = SDL_GetAtomicInt(&ring->head);
+        int tail = SDL_GetAtomicInt(&ring->tail);
+        const int dropped = SDL_SetAtomicInt(&ring->dropped, 0);
+
+        for (; tail != head; tail++)
+        {
+            LOG_Format(&ring->records[tail & (LOG_RING - 1)], line, sizeof(line));
+            fputs(line, stderr);
+            any = true;
+        }
+        SDL_SetAtomicInt(&ring->tail, tail);
+
+        if (dropped)
+            fprintf(stderr, "(log: %d records dropped, ring full)\n", dropped);
+    }
+
+    const int lost = SDL_SetAtomicInt(&log_lost, 0);
+    if (lost)
+        fprintf(stderr, "(log: %d records lost, more than %d threads)\n", lost, LOG_THREADS);
+
+    return any;
+}
+
+static int SDLCALL LOG_FlushThread(void *data)
+{
+    (void)data;
+
+    while (!SDL_GetAtomicInt(&log_quit))
+    {
+        if (!LOG_Drain())
+            SDL_WaitSemaphoreTimeout(log_wake, LOG_FLUSH_MS);
+    }
+
+    LOG_Drain();
+    return 0;
+}
+
+static void LOG_Init(void)
+{
+    SDL_SetAtomicInt(&log_quit, 0);
+    log_wake = SDL_CreateSemaphore(0);
+    log_thread = SDL_CreateThread(LOG_FlushThread, "log", NULL);
+    if (!log_thread)
+        SDL_Log("SDL_CreateThread failed: %s", SDL_GetError());
+}
+
+static void LOG_Shutdown(void)
+{
+    if (log_thread)
+    {
+        SDL_SetAtomicInt(&log_quit, 1);
+        SDL_SignalSemaphore(log_wake);
+        SDL_WaitThread(log_thread, NULL);
+        log_thread = NULL;
+    }
+    else
+    {
+        LOG_Drain();
+    }
+
+    if (log_wake)
+        SDL_DestroySemaphore(log_wake);
+    log_wake = NULL;
+}
+
+
+// -----------------------------------------------------------------------------
+// Frame phases: where the main loop is, and what each part of it costs
+// -----------------------------------------------------------------------------
+
+enum
+{
+    PH_EVENTS,
+    PH_UPDATE,
+    PH_DRAW,
+    PH_HUD,
+    PH_PRESENT,
+    PH_IDLE,
+    NUMPHASES
+};
+
+static const char *phase_names[NUMPHASES] = {
+    "events", "update", "draw", "hud", "present", "idle"
+};
+
+typedef struct
+{
+    Uint64 cycles;                        // main thread CPU cycles
+    Uint64 ticks;                         // wall clock, performance counter ticks
+} phase_cost_t;
+
+static volatile LONG prof_phase;          // main loop phase, read by the profiler
+static bool phase_cycles = true;          // thread cycle counter is readable
+static Uint64 phase_start_cycles, phase_start_ticks;
+static phase_cost_t phase_acc[NUMPHASES]; // current FPS window
+static phase_cost_t phase_last[NUMPHASES];// previous window, per frame
+static phase_cost_t phase_total[NUMPHASES];// whole run
+static int phase_frames;
+
+static Uint64 P_ThreadCycles(void)
+{
+    ULONG64 cycles = 0;
+
+    // Not every system exposes it; wall time is still measured without it
+    if (phase_cycles && !QueryThreadCycleTime(GetCurrentThread(), &cycles))
+        phase_cycles = false;
+
+    return cycles;
+}
+
+//
+// Charge the time since the last call to the phase being left.
+//
+
+static void P_SetPhase(int phase)
+{
+    const Uint64 cycles = P_ThreadCycles();
+    const Uint64 ticks = SDL_GetPerformanceCounter();
+    const int prev = (int)prof_phase;
+
+    if (phase_start_ticks)
+    {
+        phase_acc[prev].cycles += cycles - phase_start_cycles;
+        phase_acc[prev].ticks += ticks - phase_start_ticks;
+        phase_total[prev].cycles += cycles - phase_start_cycles;
+        phase_total[prev].ticks += ticks - phase_start_ticks;
+    }
+
+    if (phase == PH_EVENTS)
+        phase_frames++;
+
+    phase_start_cycles = cycles;
+    phase_start_ticks = ticks;
+    InterlockedExchange(&prof_phase, phase);
+}
+
+//
+// Close the FPS window: keep per frame averages for the overlay.
+//
+
+static void P_RollPhases(void)
+{
+    for (int p = 0; p < NUMPHASES; p++)
+    {
+        phase_last[p].cycles = phase_acc[p].cycles / MAX(phase_frames, 1);
+        phase_last[p].ticks = phase_acc[p].ticks / MAX(phase_frames, 1);
+    }
+
+    memset(phase_acc, 0, sizeof(phase_acc));
+    phase_frames = 0;
+}
+
+//
+// CPU time of the whole process (every thread), in milliseconds.
+//
+
+static Uint64 P_ProcessCPUTime(void)
+{
+    FILETIME created, exited, kernel, user;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0;
+
+    const Uint64 k = ((Uint64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    const Uint64 u = ((Uint64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+
+    return (k + u) / 10000;             // 100 ns units
+}
+
+static void P_PrintPhaseJSON(FILE *f, int count)
+{
+    const double freq = (double)SDL_GetPerformanceFrequency();
+
+    fprintf(f, "{\"stars\": %d, \"cycles\": %s, \"phases\": {", count, phase_cycles ? "true" : "false");
+    for (int p = 0; p < NUMPHASES; p++)
+    {
+        fprintf(f, "%s\"%s\": {\"ms\": %.3f, \"cycles\": %llu}", p ? ", " : "", phase_names[p],
+                phase_total[p].ticks * 1000.0 / freq, (unsigned long long)phase_total[p].cycles);
+    }
+    fprintf(f, "}}\n");
+}
+
+
+// -----------------------------------------------------------------------------
+// Idle tasks: low priority work that runs in the slack before the next
+// frame is due, in slices, or on a worker thread
+// -----------------------------------------------------------------------------
+
+#define IDLE_TASKS 8
+#define IDLE_MARGIN_NS 1000000ull         // leave this much of the slack unused
+
+typedef struct
+{
+    const char *name;
+    bool (*slice)(void);                  // one slice; false = nothing to do now
+    bool worker;                          // runs on the idle worker instead
+    Uint64 estimate;                      // ns, running average of a slice
+    SDL_AtomicInt acc_us;                 // time spent this second
+    int last_us;                          // ...and in the previous one
+} idle_task_t;
+
+static idle_task_t idle_tasks[IDLE_TASKS];
+static int num_idle_tasks;
+static SDL_Thread *idle_thread;
+static SDL_Semaphore *idle_wake;
+static SDL_AtomicInt idle_quit;
+
+static Uint64 I_RunSlice(idle_task_t *task, bool *did_work)
+{
+    const Uint64 start = SDL_GetTicksNS();
+
+    *did_work = task->slice();
+
+    const Uint64 took = SDL_GetTicksNS() - start;
+    SDL_AddAtomicInt(&task->acc_us, (int)(took / 1000));
+    return took;
+}
+
+static int SDLCALL I_IdleWorker(void *data)
+{
+    (void)data;
+
+    while (!SDL_GetAtomicInt(&idle_quit))
+    {
+        bool any = false;
+
+        for (int i = 0; i < num_idle_tasks; i++)
+        {
+            bool did_work;
+
+            if (idle_tasks[i].worker)
+            {
+                I_RunSlice(&idle_tasks[i], &did_work);
+                any |= did_work;
+            }
+        }
+
+        // Out of work until the next frame
+        if (!any)
+            SDL_WaitSemaphore(idle_wake);
+    }
+
+    return 0;
+}
+
+static void I_AddIdleTask(const char *name, bool (*slice)(void), bool worker)
+{
+    if (num_idle_tasks == IDLE_TASKS)
+        return;
+
+    idle_tasks[num_idle_tasks++] = (idle_task_t){ .name = name, .slice = slice, .worker = worker };
+
+    if (worker && !idle_thread)
+    {
+        idle_wake = SDL_CreateSemaphore(0);
+        SDL_SetAtomicInt(&idle_quit, 0);
+        idle_thread = SDL_CreateThread(I_IdleWorker, "idle", NULL);
+        if (!idle_thread)
+        {
+            LOG_Printf("SDL_CreateThread failed: %s", SDL_GetError());
+            idle_tasks[num_idle_tasks - 1].worker = false;
+        }
+    }
+}
+
+//
+// Called by the pacing code with the time the next frame is due. Main
+// thread tasks take turns, a slice at a time, as long as their usual
+// slice still fits before it.
+//
+
+static void I_RunIdleTasks(Uint64 deadline)
+{
+    bool busy[IDLE_TASKS];
+    int left = 0;
+
+    if (idle_thread)
+        SDL_SignalSemaphore(idle_wake);
+
+    for (int i = 0; i < num_idle_tasks; i++)
+        left += (busy[i] = !idle_tasks[i].worker);
+
+    while (left > 0)
+    {
+        for (int i = 0; i < num_idle_tasks; i++)
+        {
+            idle_task_t *task = &idle_tasks[i];
+            bool did_work;
+
+            if (!busy[i])
+                continue;
+
+            if (SDL_GetTicksNS() + task->estimate + IDLE_MARGIN_NS > deadline)
+            {
+                busy[i] = false;
+                left--;
+                continue;
+            }
+
+            const Uint64 took = I_RunSlice(task, &did_work);
+
+            if (did_work)
+                task->estimate = task->estimate ? (task->estimate * 3 + took) / 4 : took;
+            else
+            {
+                busy[i] = false;
+                left--;
+            }
+        }
+    }
+}
+
+//
+// Wait for the deadline, doing idle work first. Input ends the wait
+// early when wake_on_input is set.
+//
+
+static void I_WaitUntil(Uint64 deadline, bool wake_on_input)
+{
+    I_RunIdleTasks(deadline);
+
+    const Uint64 now = SDL_GetTicksNS();
+    if (now >= deadline)
+        return;
+
+    const Sint32 ms = (Sint32)((deadline - now + 999999) / 1000000);
+    if (wake_on_input)
+        SDL_WaitEventTimeout(NULL, ms);
+    else
+        SDL_Delay((Uint32)ms);
+}
+
+static void I_RollIdleTasks(void)
+{
+    for (int i = 0; i < num_idle_tasks; i++)
+        idle_tasks[i].last_us = SDL_SetAtomicInt(&idle_tasks[i].acc_us, 0);
+}
+
+static void I_ShutdownIdleTasks(void)
+{
+    if (idle_thread)
+    {
+        SDL_SetAtomicInt(&idle_quit, 1);
+        SDL_SignalSemaphore(idle_wake);
+        SDL_WaitThread(idle_thread, NULL);
+        SDL_DestroySemaphore(idle_wake);
+        idle_thread = NULL;
+    }
+    num_idle_tasks = 0;
+}
+
+
+// -----------------------------------------------------------------------------
+// Jobs: work-stealing scheduler. Every thread owns a Chase-Lev deque;
+// owners push and pop at the bottom, idle threads steal from the top.
+// Only the main thread and the job workers may push or wait.
+// -----------------------------------------------------------------------------
+
+#define JOB_MAXTHREADS 16                 // workers + the main thread
+#define JOB_DEQUE 1024                    // power of two
+#define JOB_POOL 8192
+
+typedef struct job_s job_t;
+
+typedef void (*job_fn_t)(void *data, int begin, int end);
+
+struct job_s
+{
+    job_fn_t fn;
+    void *data;
+    int begin, end;                       // range still to do, split on demand
+    int grain;                            // don't split below this
+    job_t *parent;                        // finishes after this one
+    job_t *next;                          // pushed once this one finishes
+    SDL_AtomicInt pending;                // 1 for itself + unfinished children
+};
+
+typedef struct
+{
+    SDL_AtomicInt top;                    // thieves
+    SDL_AtomicInt bottom;                 // owner
+    void *slots[JOB_DEQUE];               // only through SDL_*AtomicPointer
+} job_deque_t;
+
+static job_deque_t job_deques[JOB_MAXTHREADS];
+static job_t job_pool[JOB_POOL];
+static SDL_AtomicInt job_pool_next;
+static SDL_Thread *job_threads[JOB_MAXTHREADS];
+static int job_workers;                   // threads started, main thread not counted
+static SDL_Semaphore *job_wake[JOB_MAXTHREADS]; // one per worker, so a wake can't go astray
+static SDL_AtomicInt job_asleep[JOB_MAXTHREADS];
+static SDL_AtomicInt job_sleepers;
+static SDL_AtomicInt job_quit;
+static void *job_pinned[JOB_MAXTHREADS];  // one job for this thread only, see J_RunStatic
+static SDL_TLSID job_tls;                 // deque index + 1 of a worker thread
+
+// Deque indices only ever grow; compare them by difference so they can wrap
+#define J_DIFF(a, b) ((int)((unsigned)(a) - (unsigned)(b)))
+
+static int J_Self(void)
+{
+    return (int)(intptr_t)SDL_GetTLS(&job_tls);     // 0 on the main thread
+}
+
+// Wake worker t if it sleeps; only one wake per sleep
+static bool J_Wake(int t)
+{
+    if (!SDL_CompareAndSwapAtomicInt(&job_asleep[t], 1, 0))
+        return false;
+
+    SDL_SignalSemaphore(job_wake[t]);
+    return true;
+}
+
+static void J_Push(job_t *job)
+{
+    job_deque_t *d = &job_deques[J_Self()];
+    const int b = SDL_GetAtomicInt(&d->bottom);
+
+    SDL_SetAtomicPointer(&d->slots[b & (JOB_DEQUE - 1)], job);
+    SDL_SetAtomicInt(&d->bottom, (int)((unsigned)b + 1));
+
+    for (int t = 1; t <= job_workers && SDL_GetAtomicInt(&job_sleepers) > 0; t++)
+    {
+        if (J_Wake(t))
+            break;
+    }
+}
+
+static job_t *J_Pop(void)
+{
+    job_deque_t *d = &job_deques[J_Self()];
+    const int b = (int)((unsigned)SDL_GetAtomicInt(&d->bottom) - 1);
+
+    // Interlocked store: a full fence between it and the read of top
+    SDL_SetAtomicInt(&d->bottom, b);
+
+    const int t = SDL_GetAtomicInt(&d->top);
+
+    if (J_DIFF(b, t) < 0)
+    {
+        SDL_SetAtomicInt(&d->bottom, (int)((unsigned)b + 1));
+        return NULL;
+    }
+
+    job_t *job = SDL_GetAtomicPointer(&d->slots[b & (JOB_DEQUE - 1)]);
+
+    // Last one: race the thieves for it
+    if (t == b)
+    {
+        if (!SDL_CompareAndSwapAtomicInt(&d->top, t, (int)((unsigned)t + 1)))
+            job = NULL;
+        SDL_SetAtomicInt(&d->bottom, (int)((unsigned)b + 1));
+    }
+
+    return job;
+}
+
+static job_t *J_Steal(int victim)
+{
+    job_deque_t *d = &job_deques[victim];
+    const int t = SDL_GetAtomicInt(&d->top);
+    const int b = SDL_GetAtomicInt(&d->bottom);
+
+    if (J_DIFF(b, t) <= 0)
+        return NULL;
+
+    job_t *job = SDL_GetAtomicPointer(&d->slots[t & (JOB_DEQUE - 1)]);
+    return SDL_CompareAndSwapAtomicInt(&d->top, t, (int)((unsigned)t + 1)) ? job : NULL;
+}
+
+static job_t *J_Alloc(job_fn_t fn, void *data, int begin, int end, int grain, job_t *parent)
+{
+    const int n = SDL_AddAtomicInt(&job_pool_next, 1);
+    job_t *job;
+
+    // Pool is reset between batches, see J_Wait
+    if (n >= JOB_POOL)
+        return NULL;
+
+    job = &job_pool[n];
+    job->fn = fn;
+    job->data = data;
+    job->begin = begin;
+    job->end = end;
+    job->grain = MAX(grain, 1);
+    job->parent = parent;
+    job->next = NULL;
+    SDL_SetAtomicInt(&job->pending, 1);
+
+    if (parent)
+        SDL_AddAtomicInt(&parent->pending, 1);
+
+    return job;
+}
+
+//
+// Links are read before the count drops: once the waited-on job reaches
+// zero, J_Wait recycles the pool and the slot may be reused at once.
+//
+
+static void J_Finish(job_t *job)
+{
+    while (job)
+    {
+        job_t *const next = job->next;
+        job_t *const parent = job->parent;
+
+        if (SDL_AddAtomicInt(&job->pending, -1) != 1)
+            break;
+        if (next)
+            J_Push(next);
+        job = parent;
+    }
+}
+
+//
+// Run a job: while its range is bigger than the grain, hand the upper
+// half to a child on our deque (that's what thieves take), then do the rest.
+//
+
+static void J_Execute(job_t *job)
+{
+    while (job->end - job->begin > job->grain)
+    {
+        const int mid = job->begin + (job->end - job->begin) / 2;
+        job_t *child = J_Alloc(job->fn, job->data, mid, job->end, job->grain, job);
+
+        if (!child)
+            break;
+
+        job->end = mid;
+        J_Push(child);
+    }
+
+    job->fn(job->data, job->begin, job->end);
+    J_Finish(job);
+}
+
+static bool J_RunOne(void)
+{
+    const int self = J_Self();
+    job_t *job = NULL;
+
+    // A job pinned to this thread, then own work, then look around,
+    // starting next door
+    if (SDL_GetAtomicPointer(&job_pinned[self]))
+        job = SDL_SetAtomicPointer(&job_pinned[self], NULL);
+    if (!job)
+        job = J_Pop();
+
+    for (int i = 1; !job && i <= job_workers; i++)
+        job = J_Steal((self + i) % (job_workers + 1));
+
+    if (job)
+        J_Execute(job);
+
+    return job != NULL;
+}
+
+static int SDLCALL J_WorkerThread(void *data)
+{
+    SDL_SetTLS(&job_tls, data, NULL);
+
+    while (!SDL_GetAtomicInt(&job_quit))
+    {
+        if (!J_RunOne())
+        {
+            // Count as asleep before the last look: J_Push either sees us
+            // and signals, or pushed before that look and we find the job
+            const int self = (int)(intptr_t)data;
+
+            SDL_SetAtomicInt(&job_asleep[self], 1);
+            SDL_AddAtomicInt(&job_sleepers, 1);
+            if (!J_RunOne())
+                SDL_WaitSemaphore(job_wake[self]);
+            SDL_AddAtomicInt(&job_sleepers, -1);
+            SDL_SetAtomicInt(&job_asleep[self], 0);
+        }
+    }
+
+    return 0;
+}
+
+//
+// Workers start on first use (counter-based updates, the benchmarks), at
+// most once per run; until then the main thread runs every job itself.
+//
+
+static void J_Init(void)
+{
+    static bool started;
+
+    if (started || JOB_THREADS < 0)
+        return;
+    started = true;
+
+    const int want = JOB_THREADS ? JOB_THREADS : SDL_GetNumLogicalCPUCores() - 1;
+
+    SDL_SetAtomicInt(&job_quit, 0);
+
+    for (int i = 1; i <= MIN(want, JOB_MAXTHREADS - 1); i++)
+    {
+        job_wake[i] = SDL_CreateSemaphore(0);
+        job_threads[i] = SDL_CreateThread(J_WorkerThread, "job", (void *)(intptr_t)i);
+        if (!job_threads[i])
+        {
+            LOG_Printf("SDL_CreateThread failed: %s", SDL_GetError());
+            break;
+        }
+        job_workers = i;
+    }
+}
+
+static void J_Shutdown(void)
+{
+    SDL_SetAtomicInt(&job_quit, 1);
+
+    for (int i = 1; i <= job_workers; i++)
+    {
+        SDL_SignalSemaphore(job_wake[i]);
+        SDL_WaitThread(job_threads[i], NULL);
+    }
+
+    for (int i = 1; i < JOB_MAXTHREADS; i++)
+    {
+        if (job_wake[i])
+            SDL_DestroySemaphore(job_wake[i]);
+        job_wake[i] = NULL;
+    }
+    job_workers = 0;
+}
+
+//
+// Helping wait, main thread only: run jobs until this one (and all of its
+// children and successors) are done, then recycle the pool.
+//
+
+static void J_Wait(job_t *job)
+{
+    while (SDL_GetAtomicInt(&job->pending) > 0)
+    {
+        if (!J_RunOne())
+            SDL_CPUPauseInstruction();
+    }
+
+    SDL_SetAtomicInt(&job_pool_next, 0);
+}
+
+//
+// fn(data, begin, end) over [begin, end) in grain-sized pieces or more.
+// Without workers (or pool space) it simply runs here.
+//
+
+static void J_ParallelFor(job_fn_t fn, void *data, int begin, int end, int grain)
+{
+    job_t *root = job_workers ? J_Alloc(fn, data, begin, end, grain, NULL) : NULL;
+
+    if (!root)
+    {
+        fn(data, begin, end);
+        return;
+    }
+
+    J_Push(root);
+    J_Wait(root);
+}
+
+//
+// Static partition, for comparison with work stealing: thread t gets the
+// t-th contiguous piece of [begin, end), which is neither split nor
+// stolen, and the call returns when all pieces are done.
+//
+
+static void J_RunStatic(job_fn_t fn, void *data, int begin, int end)
+{
+    const int threads = job_workers + 1;
+    const int len = end - begin;
+    job_t *root = J_Alloc(fn, data, begin, begin + len / threads, len, NULL);
+
+    if (!root)
+    {
+        fn(data, begin, end);
+        return;
+    }
+
+    for (int t = 1; t < threads; t++)
+    {
+        const int from = begin + (int)((long long)len * t / threads);
+        const int to = begin + (int)((long long)len * (t + 1) / threads);
+        job_t *piece = J_Alloc(fn, data, from, to, len, root);
+
+        if (piece)
+        {
+            SDL_SetAtomicPointer(&job_pinned[t], piece);
+            J_Wake(t);
+        }
+        else
+        {
+            fn(data, from, to);
+        }
+    }
+
+    J_Execute(root);
+    J_Wait(root);
+}
+
+//
+// -jobbench: frames of clustered, uneven work through update -> raster ->
+// resolve, once split by work stealing and once as one chunk per thread.
+//
+
+#define BENCH_ITEMS 8192
+#define BENCH_TILES 64
+#define BENCH_FRAMES 300
+
+static volatile Uint32 bench_sink;
+
+static void J_BenchWork(int units)
+{
+    Uint32 h = (Uint32)units;
+
+    for (int i = 0; i < units * 64; i++)
+        h = h * 1664525u + 1013904223u;
+    bench_sink ^= h;
+}
+
+static void J_BenchUpdate(void *data, int begin, int end)
+{
+    (void)data;
+
+    // A cluster: an eighth of the items cost 20 times more
+    for (int i = begin; i < end; i++)
+        J_BenchWork(i >= BENCH_ITEMS / 2 && i < BENCH_ITEMS / 2 + BENCH_ITEMS / 8 ? 20 : 1);
+}
+
+static void J_BenchRaster(void *data, int begin, int end)
+{
+    (void)data;
+
+    for (int t = begin; t < end; t++)
+        J_BenchWork(t % 7 == 0 ? 800 : 60);
+}
+
+static void J_BenchResolve(void *data, int begin, int end)
+{
+    (void)data;
+    (void)begin;
+    (void)end;
+    J_BenchWork(200);
+}
+
+static int J_CompareU64(const void *a, const void *b)
+{
+    const Uint64 x = *(const Uint64 *)a, y = *(const Uint64 *)b;
+    return (x > y) - (x < y);
+}
+
+static int J_RunBenchmark(void)
+{
+    static Uint64 times[BENCH_FRAMES];
+    const int threads = job_workers + 1;
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        for (int f = 0; f < BENCH_FRAMES; f++)
+        {
+            const Uint64 start = SDL_GetTicksNS();
+
+            if (mode)
+            {
+                // Static: one contiguous piece per thread, a barrier between stages
+                J_RunStatic(J_BenchUpdate, NULL, 0, BENCH_ITEMS);
+                J_RunStatic(J_BenchRaster, NULL, 0, BENCH_TILES);
+                J_BenchResolve(NULL, 0, 1);
+            }
+            else
+            {
+                job_t *resolve = J_Alloc(J_BenchResolve, NULL, 0, 1, 1, NULL);
+                job_t *raster = J_Alloc(J_BenchRaster, NULL, 0, BENCH_TILES, 1, NULL);
+                job_t *update = J_Alloc(J_BenchUpdate, NULL, 0, BENCH_ITEMS, 64, NULL);
+
+                // update -> raster -> resolve
+                raster->next = resolve;
+                update->next = raster;
+                J_Push(update);
+                J_Wait(resolve);
+            }
+
+            times[f] = SDL_GetTicksNS() - start;
+        }
+
+        qsort(times, BENCH_FRAMES, sizeof(times[0]), J_CompareU64);
+        printf("%-14s %d threads: p50 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+               mode ? "static split" : "work stealing", threads,
+               times[BENCH_FRAMES / 2] / 1e6, times[BENCH_FRAMES * 99 / 100] / 1e6,
+               times[BENCH_FRAMES - 1] / 1e6);
+    }
+
+    return 0;
+}
+
+
+// -----------------------------------------------------------------------------
+// Renderer
+// -----------------------------------------------------------------------------
+
+static void R_RandomizeStarColor(short *r, short *g, short *b)
+{
+    if (COLORED_STARS)
+    {
+        *r = (short)(M_RealRandom() % 256);
+        *g = (short)(M_RealRandom() % 256);
+        *b = (short)(M_RealRandom() % 256);
+    }
+    else
+    {
+        short gray = (short)(M_RealRandom() % 256);
+        *r = *g = *b = gray;
+    }
+}
+
+//
+// Size classes. Each star keeps a random draw and its class comes from a
+// geometric distribution over 1..STAR_SIZE, so changing STAR_SIZE or the
+// falloff resizes the field at once.
+//
+
+static int size_cdf[MAXSIZE + 1];         // size_cdf[s]: draws below it are size <= s
+static int size_cdf_max, size_cdf_falloff;
+
+static int R_StarSize(const star_t *st)
+{
+    if (!SIZE_DIST)
+        return STAR_SIZE;
+
+    if (size_cdf_max != STAR_SIZE || size_cdf_falloff != SIZE_FALLOFF)
+    {
+        double w = 1, total = 0, sum = 0;
+
+        for (int s = 1; s <= STAR_SIZE; s++, w *= SIZE_FALLOFF / 100.0)
+            total += w;
+
+        w = 1;
+        for (int s = 1; s <= STAR_SIZE; s++, w *= SIZE_FALLOFF / 100.0)
+        {
+            sum += w;
+            size_cdf[s] = (int)(32768.0 * sum / total);
+        }
+        size_cdf[STAR_SIZE] = 32768;
+        size_cdf_max = STAR_SIZE;
+        size_cdf_falloff = SIZE_FALLOFF;
+    }
+
+    int size = 1;
+    while (st->size_r >= size_cdf[size])
+        size++;
+    return size;
+}
+
+//
+// Counter-based mode. Every star's parameters come from M_CounterRandom
+// keyed by (seed, star, generation), and its life is analytic: position
+// and brightness are linear in its age, and the update it respawns on is
+// known at birth. Any tic can be computed directly (R_SeekStars), and
+// stars don't depend on each other or on update order.
+//
+// Seeking assumes speed, fading and field size were the same since tic 0.
+// When one of them changes, stars are rebased: their current state becomes
+// a new birth, so they carry on smoothly from where they are.
+//
+
+static uint32_t star_seed;                // seed of the counter-based field
+static Uint64 star_tic;                   // updates since R_InitStars
+static int star_speed, star_step, star_w; // settings the lifetimes assume
+
+static float R_StarX(const star_t *st, Uint64 age)
+{
+    return st->x0 + (float)age * (((float)STAR_SPEED * st->speed) / 6);
+}
+
+static bool R_StarOut(const star_t *st, Uint64 age, int maxx)
+{
+    const float x = R_StarX(st, age);
+    return STAR_SPEED > 0 ? x > (float)maxx : x < 0;
+}
+
+// Updates until respawn; edge tells if it leaves the screen (1 = right, 2 = left)
+static Uint64 R_StarLifetime(const star_t *st, int maxx, int *edge)
+{
+    // Without fading only dark stars are replaced, the rest live until they leave
+    const Uint64 fade = BRIGHTNESS_STEP ? MAX(1, (st->b0 + BRIGHTNESS_STEP - 1) / BRIGHTNESS_STEP)
+                      : st->b0 > 0 ? (Uint64)1 << 62 : 1;
+
+    *edge = 0;
+
+    if (STAR_SPEED != 0)
+    {
+        const float dx = fabsf(((float)STAR_SPEED * st->speed) / 6);
+        const float room = STAR_SPEED > 0 ? (float)maxx - st->x0 : st->x0;
+        Uint64 k = (Uint64)(room > 0 ? room / dx : 0) + 1;
+
+        // The estimate can be one off in float, settle on the exact test
+        while (k > 1 && R_StarOut(st, k - 1, maxx))
+            k--;
+        while (!R_StarOut(st, k, maxx))
+            k++;
+
+        if (k <= fade)
+        {
+            *edge = STAR_SPEED > 0 ? 1 : 2;
+            return k;
+        }
+    }
+
+    return fade;
+}
+
+static void R_BirthStar(star_t *st, int i, int maxx, int maxy, int edge)
+{
+    #define STAR_RANDOM(n) M_CounterRandom(star_seed, (uint32_t)i, st->gen, n)
+
+    st->x0 = edge == 1 ? 0 : edge == 2 ? (float)maxx : (float)(STAR_RANDOM(0) % maxx);
+    st->y = (float)(STAR_RANDOM(1) % maxy);
+    st->speed = 0.5f + ((STAR_RANDOM(2) % 100) / 100.0f);
+    st->b0 = st->gen ? 128 + (STAR_RANDOM(3) % 128) : STAR_RANDOM(3) % 256;
+
+    if (COLORED_STARS)
+    {
+        st->r = (short)(STAR_RANDOM(4) % 256);
+        st->g = (short)(STAR_RANDOM(5) % 256);
+        st->b = (short)(STAR_RANDOM(6) % 256);
+    }
+    else
+    {
+        st->r = st->g = st->b = (short)(STAR_RANDOM(7) % 256);
+    }
+
+    st->size_r = (short)(SIZE_DIST ? STAR_RANDOM(8) : 0);
+
+    #undef STAR_RANDOM
+
+    st->life = R_StarLifetime(st, maxx, &edge);
+}
+
+// Respawn until alive at tic, then place the star at its age
+static void R_AdvanceStar(star_t *st, int i, int maxx, int maxy, Uint64 tic)
+{
+    while (tic - st->birth >= st->life)
+    {
+        int edge;
+
+        R_StarLifetime(st, maxx, &edge);
+        st->birth += st->life;
+        st->gen++;
+        R_BirthStar(st, i, maxx, maxy, edge);
+    }
+
+    const Uint64 age = tic - st->birth;
+    const Uint64 fade = age * (Uint64)BRIGHTNESS_STEP;
+
+    st->x = R_StarX(st, age);
+    st->brightness = fade >= (Uint64)st->b0 ? 0 : st->b0 - (int)fade;
+}
+
+//
+// The whole field at any tic. All MAXSTARS (or more, for -simbench) are
+// placed, so changing NUM_STARS doesn't change any star.
+//
+// Known limit: this is O(stars * generations), not O(stars). Each star
+// replays every respawn since tic 0, because a generation's length is only
+// known once it is born, so a late joiner or a far seek costs time linear
+// in the target tic (a star lives a few hundred tics at the default
+// settings). Checkpoints would not help a joiner, which has none.
+//
+
+static void R_SeekStars(int count, int maxx, int maxy, Uint64 tic)
+{
+    if (maxx <= 0 || maxy <= 0) return;
+
+    star_tic = tic;
+    star_speed = STAR_SPEED;
+    star_step = BRIGHTNESS_STEP;
+    star_w = maxx;
+
+    for (int i = 0; i < count; i++)
+    {
+        stars[i].gen = 0;
+        stars[i].birth = 0;
+        R_BirthStar(&stars[i], i, maxx, maxy, 0);
+        R_AdvanceStar(&stars[i], i, maxx, maxy, tic);
+    }
+}
+
+#define STAR_GRAIN 32                     // stars per job at least
+static int star_advance_w, star_advance_h;
+
+static void R_AdvanceStars(void *data, int begin, int end)
+{
+    (void)data;
+
+    for (int i = begin; i < end; i++)
+        R_AdvanceStar(&stars[i], i, star_advance_w, star_advance_h, star_tic);
+}
+
+static void R_UpdateStarsCounter(int count, int maxx, int maxy)
+{
+    J_Init();
+    star_tic++;
+
+    // Settings changed: rebase, so lifetimes match them again
+    if (STAR_SPEED != star_speed || BRIGHTNESS_STEP != star_step || maxx != star_w)
+    {
+        int edge;
+
+        for (int i = 0; i < count; i++)
+        {
+            stars[i].x0 = stars[i].x;
+            stars[i].b0 = MAX(0, stars[i].brightness);
+            stars[i].birth = star_tic - 1;
+            stars[i].life = R_StarLifetime(&stars[i], maxx, &edge);
+        }
+
+        star_speed = STAR_SPEED;
+        star_step = BRIGHTNESS_STEP;
+        star_w = maxx;
+    }
+
+    // Stars don't depend on each other, any order (or thread) will do;
+    // big fields split coarser, so the splits fit in the job pool
+    star_advance_w = maxx;
+    star_advance_h = maxy;
+    J_ParallelFor(R_AdvanceStars, NULL, 0, count, MAX(STAR_GRAIN, count / (JOB_POOL / 2)));
+}
+
+static void R_InitStars(int count, int maxx, int maxy)
+{
+    if (maxx <= 0 || maxy <= 0) return;
+
+    if (COUNTER_RNG)
+    {
+        star_seed = m_rand_seed;
+        R_SeekStars(MAX(count, MAXSTARS), maxx, maxy, 0);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        stars[i].x = (float)(M_RealRandom() % maxx);
+        stars[i].y = (float)(M_RealRandom() % maxy);
+        stars[i].speed = 0.5f + ((M_RealRandom() % 100) / 100.0f);
+        stars[i].brightness = M_RealRandom() % 256;
+        R_RandomizeStarColor(&stars[i].r, &stars[i].g, &stars[i].b);
+        stars[i].size_r = (short)(SIZE_DIST ? M_RealRandom() : 0);
+    }
+}
+
+//
+// Respawn ring: a background thread keeps a single-producer/single-consumer
+// ring of ready-made respawn parameters filled, so a respawn storm (large
+// BRIGHTNESS_STEP, fast drift) pops records instead of running RNG chains.
+// Counters run modulo twice the ring size to tell full from empty. The
+// thread has its own RNG state, so this mode is not deterministic.
+//
+
+#define RESPAWN_SIZE  1024                // records, power of two
+#define RESPAWN_MASK  (RESPAWN_SIZE * 2 - 1)
+#define RESPAWN_BATCH 64                  // records published at once
+
+typedef struct
+{
+    int rx, ry;                           // raw random numbers for x and y
+    float speed;
+    int brightness;
+    short r, g, b;                        // colored stars
+    short gray;                           // grayscale stars
+    short size_r;                         // size class draw
+} respawn_t;
+
+static respawn_t respawn_ring[RESPAWN_SIZE];
+static SDL_AtomicInt respawn_head;        // next record to fill (producer)
+static SDL_AtomicInt respawn_tail;        // next record to use (consumer)
+static SDL_AtomicInt respawn_quit;
+static SDL_Semaphore *respawn_wake;       // consumer drained half the ring
+static SDL_Thread *respawn_thread;
+static int respawn_pos;                   // consumer's unpublished tail
+static int respawn_avail;                 // records known to be ready
+
+static int SDLCALL R_RespawnThread(void *data)
+{
+    uint32_t seed = *(uint32_t *)data;
+    int head = 0;
+
+    while (!SDL_GetAtomicInt(&respawn_quit))
+    {
+        int space = RESPAWN_SIZE - ((head - SDL_GetAtomicInt(&respawn_tail)) & RESPAWN_MASK);
+
+        while (space > 0)
+        {
+            const int batch = MIN(space, RESPAWN_BATCH);
+
+            for (int n = 0; n < batch; n++)
+            {
+                respawn_t *rec = &respawn_ring[(head + n) & (RESPAWN_SIZE - 1)];
+
+                rec->rx = M_RandomFrom(&seed);
+                rec->ry = M_RandomFrom(&seed);
+                rec->speed = 0.5f + ((M_RandomFrom(&seed) % 100) / 100.0f);
+                rec->brightness = 128 + (M_RandomFrom(&seed) % 128);
+                rec->r = (short)(M_RandomFrom(&seed) % 256);
+                rec->g = (short)(M_RandomFrom(&seed) % 256);
+                rec->b = (short)(M_RandomFrom(&seed) % 256);
+                rec->gray = (short)(M_RandomFrom(&seed) % 256);
+                rec->size_r = (short)M_RandomFrom(&seed);
+            }
+
+            head = (head + batch) & RESPAWN_MASK;
+            SDL_SetAtomicInt(&respawn_head, head); // full barrier, publishes the records
+            space -= batch;
+        }
+
+        // Full: the consumer signals once it's used half, R_StopRespawnThread to quit
+        SDL_WaitSemaphore(respawn_wake);
+    }
+
+    return 0;
+}
+
+static void R_StartRespawnThread(void)
+{
+    static uint32_t seed;
+
+    seed = m_rand_seed ^ 0x9e3779b9u;
+    respawn_wake = SDL_CreateSemaphore(0);
+    respawn_thread = SDL_CreateThread(R_RespawnThread, "respawn", &seed);
+
+    if (!respawn_thread)
+        SDL_Log("SDL_CreateThread failed: %s", SDL_GetError());
+}
+
+static void R_StopRespawnThread(void)
+{
+    if (respawn_thread)
+    {
+        SDL_SetAtomicInt(&respawn_quit, 1);
+        SDL_SignalSemaphore(respawn_wake);
+        SDL_WaitThread(respawn_thread, NULL);
+        respawn_thread = NULL;
+    }
+    if (respawn_wake)
+        SDL_DestroySemaphore(respawn_wake);
+    respawn_wake = NULL;
+}
+
+static bool R_PopRespawn(respawn_t *rec)
+{
+    if (!respawn_avail)
+        return false;
+
+    *rec = respawn_ring[respawn_pos & (RESPAWN_SIZE - 1)];
+    respawn_pos = (respawn_pos + 1) & RESPAWN_MASK;
+    respawn_avail--;
+    return true;
+}
+
+//
+// Flow field. A coarse grid of curl-noise velocities (divergence free, so
+// stars swirl instead of bunching up) is regenerated in the background and
+// swapped in under flow_lock; the update samples it bilinearly. Tic-locked
+// runs rebuild it in place every few tics to stay deterministic.
+//
+
+#define FLOW_REGEN_MS   100               // background regeneration period
+#define FLOW_REGEN_TICS 4                 // same for tic-locked runs
+#define FLOW_FEATURES   3.0f              // noise features across the screen
+
+typedef struct
+{
+    int w, h;                             // cells, (w + 1) * (h + 1) nodes
+    float *v;                             // vx, vy per node
+} flow_grid_t;
+
+static flow_grid_t flow_grids[2];
+static int flow_front;                    // grid the update samples
+static SDL_Mutex *flow_lock;              // guards flow_front
+static SDL_Thread *flow_thread;
+static SDL_Semaphore *flow_wake;
+static SDL_AtomicInt flow_quit;
+static SDL_AtomicInt flow_active;         // 0 while FLOW_FIELD is off: the thread sleeps
+static SDL_AtomicInt flow_tic;            // params for the next build
+static SDL_AtomicInt flow_w, flow_h;
+
+static float R_FlowPotential(float x, float y, float t)
+{
+    return M_Noise2D(x + t * 0.3f, y)
+         + M_Noise2D(x * 2.0f - t * 0.2f, y * 2.0f + t * 0.1f + 7.0f) * 0.5f;
+}
+
+static void R_BuildFlowGrid(flow_grid_t *g, Uint64 tic, int maxx, int maxy)
+{
+    const int w = FLOW_GRID;
+    const int h = MAX(1, (w * maxy + maxx / 2) / MAX(1, maxx));
+    const float t = (float)tic / TICRATE * FLOW_EVOLVE / 100.0f;
+    const float scale = FLOW_FEATURES / w;    // noise units per cell
+    const float e = 0.01f;
+
+    if (g->w != w || g->h != h || !g->v)
+    {
+        free(g->v);
+        g->v = malloc((size_t)(w + 1) * (h + 1) * 2 * sizeof(*g->v));
+        g->w = g->v ? w : 0;
+        g->h = g->v ? h : 0;
+        if (!g->v)
+            return;
+    }
+
+    for (int j = 0; j <= h; j++)
+    {
+        for (int i = 0; i <= w; i++)
+        {
+            const float px = i * scale, py = j * scale;
+            float *n = g->v + 2 * (j * (w + 1) + i);
+
+            // Curl of the potential: (dP/dy, -dP/dx)
+            n[0] =  (R_FlowPotential(px, py + e, t) - R_FlowPotential(px, py - e, t)) / (2 * e);
+            n[1] = -(R_FlowPotential(px + e, py, t) - R_FlowPotential(px - e, py, t)) / (2 * e);
+        }
+    }
+}
+
+static int SDLCALL R_FlowThread(void *data)
+{
+    (void)data;
+
+    while (!SDL_GetAtomicInt(&flow_quit))
+    {
+        const int back = 1 - flow_front;  // only this thread swaps
+
+        // Nothing samples the field while it's off, so no rebuilds either
+        if (!SDL_GetAtomicInt(&flow_active))
+        {
+            SDL_WaitSemaphore(flow_wake);
+            continue;
+        }
+
+        R_BuildFlowGrid(&flow_grids[back], (Uint64)(unsigned)SDL_GetAtomicInt(&flow_tic),
+                        SDL_GetAtomicInt(&flow_w), SDL_GetAtomicInt(&flow_h));
+
+        SDL_LockMutex(flow_lock);
+        flow_front = back;
+        SDL_UnlockMutex(flow_lock);
+
+        SDL_WaitSemaphoreTimeout(flow_wake, FLOW_REGEN_MS);
+    }
+
+    return 0;
+}
+
+static void R_UpdateFlow(Uint64 tic, int maxx, int maxy, bool threaded)
+{
+    if (!FLOW_FIELD || maxx <= 0 || maxy <= 0)
+    {
+        SDL_SetAtomicInt(&flow_active, 0);
+        return;
+    }
+
+    if (!flow_lock)
+        flow_lock = SDL_CreateMutex();
+
+    SDL_SetAtomicInt(&flow_tic, (int)tic);
+    SDL_SetAtomicInt(&flow_w, maxx);
+    SDL_SetAtomicInt(&flow_h, maxy);
+
+    if (threaded)
+    {
+        const bool resumed = SDL_CompareAndSwapAtomicInt(&flow_active, 0, 1);
+
+        if (!flow_thread)
+        {
+            flow_wake = SDL_CreateSemaphore(0);
+            flow_thread = SDL_CreateThread(R_FlowThread, "flow", NULL);
+            if (!flow_thread)
+                LOG_Printf("SDL_CreateThread failed: %s", SDL_GetError());
+        }
+        else if (resumed)
+        {
+            SDL_SignalSemaphore(flow_wake);
+        }
+    }
+    else if (tic % FLOW_REGEN_TICS == 0 || !flow_grids[flow_front].v)
+    {
+        R_BuildFlowGrid(&flow_grids[flow_front], tic, maxx, maxy);
+    }
+}
+
+static void R_ShutdownFlow(void)
+{
+    if (flow_thread)
+    {
+        SDL_SetAtomicInt(&flow_quit, 1);
+        SDL_SignalSemaphore(flow_wake);
+        SDL_WaitThread(flow_thread, NULL);
+        SDL_DestroySemaphore(flow_wake);
+        flow_thread = NULL;
+    }
+    if (flow_lock)
+        SDL_DestroyMutex(flow_lock);
+    flow_lock = NULL;
+    for (int k = 0; k < 2; k++)
+    {
+        free(flow_grids[k].v);
+        flow_grids[k].v = NULL;
+    }
+}
+
+static void R_FlowVelocity(const flow_grid_t *g, float x, float y, int maxx, int maxy,
+                           float *vx, float *vy)
+{
+    const float gx = x * g->w / maxx;
+    const float gy = y * g->h / maxy;
+    const int   i = BETWEEN(0, g->w - 1, (int)gx);
+    const int   j = BETWEEN(0, g->h - 1, (int)gy);
+    const float fx = BETWEEN(0.0f, 1.0f, gx - i);
+    const float fy = BETWEEN(0.0f, 1.0f, gy - j);
+    const float *n00 = g->v + 2 * (j * (g->w + 1) + i);
+    const float *n01 = n00 + 2 * (g->w + 1);
+
+    *vx = (n00[0] + (n00[2] - n00[0]) * fx) * (1 - fy) + (n01[0] + (n01[2] - n01[0]) * fx) * fy;
+    *vy = (n00[1] + (n00[3] - n00[1]) * fx) * (1 - fy) + (n01[1] + (n01[3] - n01[1]) * fx) * fy;
+}
+
+static void R_UpdateStars(int count, int maxx, int maxy)
+{
+    if (maxx <= 0 || maxy <= 0) return;
+
+    if (COUNTER_RNG)
+    {
+        R_UpdateStarsCounter(count, maxx, maxy);
+        return;
+    }
+
+    // Flow grid stays put while we sample it
+    const flow_grid_t *flow = NULL;
+    if (FLOW_FIELD && flow_lock)
+    {
+        SDL_LockMutex(flow_lock);
+        flow = flow_grids[flow_front].v ? &flow_grids[flow_front] : NULL;
+    }
+
+    // One look at the producer per update
+    const int respawn_start = respawn_pos;
+    if (respawn_thread)
+        respawn_avail = (SDL_GetAtomicInt(&respawn_head) - respawn_pos) & RESPAWN_MASK;
+
+    for (int i = 0; i < count; i++)
+    {
+        // Movement: global speed * star-specific coefficient / fine-tuning
+        if (flow)
+        {
+            // Along the flow, wrapping around the edges
+            const float k = ((float)STAR_SPEED * stars[i].speed) / 6;
+            float vx, vy;
+
+            R_FlowVelocity(flow, stars[i].x, stars[i].y, maxx, maxy, &vx, &vy);
+            stars[i].x += vx * k;
+            stars[i].y += vy * k;
+
+            if (stars[i].x < 0)               stars[i].x += (float)maxx;
+            else if (stars[i].x >= (float)maxx) stars[i].x -= (float)maxx;
+            if (stars[i].y < 0)               stars[i].y += (float)maxy;
+            else if (stars[i].y >= (float)maxy) stars[i].y -= (float)maxy;
+        }
+        else
+        {
+            stars[i].x += ((float)STAR_SPEED * stars[i].speed) / 6;
+        }
+
+        // Brightness logics
+        if (stars[i].brightness > 0)
+        {
+            stars[i].brightness -= BRIGHTNESS_STEP;
+            if (stars[i].brightness < 0)
+                stars[i].brightness = 0;
+        }
+
+        // Check for leaving screen bounds (on both sides) and fading out
+        const bool out_right = (!flow && STAR_SPEED > 0 && stars[i].x > (float)maxx);
+        const bool out_left  = (!flow && STAR_SPEED < 0 && stars[i].x < 0);
+        
+        if (out_right || out_left || stars[i].brightness <= 0)
+        {
+            respawn_t rec;
+            const bool ready = R_PopRespawn(&rec);
+
+            // Respawn on the opposite side or at a random position
+            if (out_right)
+            {
+                stars[i].x = 0;
+            }
+            else if (out_left)
+            {
+                stars[i].x = (float)maxx;
+            }
+            else
+            {
+                stars[i].x = (float)((ready ? rec.rx : M_RealRandom()) % maxx);
+            }
+
+            if (ready)
+            {
+                stars[i].y = (float)(rec.ry % maxy);
+                stars[i].speed = rec.speed;
+                stars[i].brightness = rec.brightness;
+                stars[i].r = COLORED_STARS ? rec.r : rec.gray;
+                stars[i].g = COLORED_STARS ? rec.g : rec.gray;
+                stars[i].b = COLORED_STARS ? rec.b : rec.gray;
+                stars[i].size_r = SIZE_DIST ? rec.size_r : 0;
+                continue;
+            }
+
+            stars[i].y = (float)(M_RealRandom() % maxy);
+            stars[i].speed = 0.5f + ((M_RealRandom() % 100) / 100.0f);
+            stars[i].brightness = 128 + (M_RealRandom() % 128); 
+            R_RandomizeStarColor(&stars[i].r, &stars[i].g, &stars[i].b);
+            stars[i].size_r = (short)(SIZE_DIST ? M_RealRandom() : 0);
+        }
+    }
+
+    if (flow)
+        SDL_UnlockMutex(flow_lock);
+
+    // Hand used records back, wake the producer once half the ring is gone
+    if (respawn_pos != respawn_start)
+    {
+        SDL_SetAtomicInt(&respawn_tail, respawn_pos);
+        if (respawn_avail < RESPAWN_SIZE / 2)
+            SDL_SignalSemaphore(respawn_wake);
+    }
+}
+
+//
+// Star i is back in the count after being left out: it is replaced on the
+// next update like a faded star, rather than shown in the state it was
+// left in (maybe minutes ago).
+//
+
+static void R_RespawnStar(int i)
+{
+    star_t *st = &stars[i];
+
+    st->brightness = st->pb = 0;
+
+    // Counter-based: a one-update life from here, then the next generation
+    if (COUNTER_RNG)
+    {
+        st->x0 = st->x;
+        st->b0 = 0;
+        st->birth = star_tic;
+        st->life = 1;
+    }
+}
+
+//
+// Motion blur: positions before the frame's updates, and afterwards
+// forget the ones that jumped (respawned or wrapped around).
+//
+
+static void R_SaveMotion(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        stars[i].px = stars[i].x;
+        stars[i].py = stars[i].y;
+        stars[i].pb = stars[i].brightness;
+    }
+}
+
+static void R_EndMotion(int count, int maxx, int maxy)
+{
+    for (int i = 0; i < count; i++)
+    {
+        star_t *st = &stars[i];
+
+        if (st->brightness > st->pb || fabsf(st->x - st->px) > maxx / 4.0f || fabsf(st->y - st->py) > maxy / 4.0f)
+        {
+            st->px = st->x;
+            st->py = st->y;
+        }
+    }
+}
+
+//
+// FNV-1a over the simulated state, to compare lockstep processes.
+//
+
+static uint32_t R_HashStars(int count)
+{
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < count; i++)
+    {
+        const star_t *st = &stars[i];
+        uint32_t v[5];
+
+        memcpy(&v[0], &st->x, sizeof(v[0]));
+        memcpy(&v[1], &st->y, sizeof(v[1]));
+        memcpy(&v[2], &st->speed, sizeof(v[2]));
+        v[3] = (uint32_t)st->brightness;
+        v[4] = (uint32_t)(st->r << 16 ^ st->g << 8 ^ st->b);
+
+        for (int j = 0; j < 5; j++)
+        {
+            for (int k = 0; k < 32; k += 8)
+            {
+                h ^= (v[j] >> k) & 0xff;
+                h *= 16777619u;
+            }
+        }
+    }
+
+    return h;
+}
+
+//
+// Scene settings in and out of the config variables, and the swap that
+// makes the other field current for a while: its stars and its settings
+// trade places with the shown ones, so the update and drawing code runs
+// on it unchanged.
+//
+
+static void PL_Get(scene_params_t *p)
+{
+    *p = (scene_params_t){ NUM_STARS, BRIGHTNESS_STEP, COLORED_STARS, STAR_SPEED,
+                           STAR_SIZE, SIZE_DIST, SIZE_FALLOFF,
+                           { SHAPE_DISC_MIN, SHAPE_CROSS_MIN, SHAPE_SPIKES_MIN },
+                           AURORA, MOTION_BLUR };
+}
+
+static void PL_Set(const scene_params_t *p)
+{
+    NUM_STARS        = p->num_stars;
+    BRIGHTNESS_STEP  = p->brightness_step;
+    COLORED_STARS    = p->colored_stars;
+    STAR_SPEED       = p->star_speed;
+    STAR_SIZE        = p->star_size;
+    SIZE_DIST        = p->size_dist;
+    SIZE_FALLOFF     = p->size_falloff;
+    SHAPE_DISC_MIN   = p->shapes[0];
+    SHAPE_CROSS_MIN  = p->shapes[1];
+    SHAPE_SPIKES_MIN = p->shapes[2];
+    AURORA           = p->aurora;
+    MOTION_BLUR      = p->motion_blur;
+}
+
+static void PL_Swap(void)
+{
+    scene_params_t shown;
+    star_t *const field = stars;
+
+    PL_Get(&shown);
+    PL_Set(&pl_incoming);
+    pl_incoming = shown;
+    stars = back_stars;
+    back_stars = field;
+}
+
+//
+// -simbench: the update pipeline alone (movement, fading, respawns and
+// their RNG) over a heap field of any size, with the configured kernel,
+// once on all job threads and once on the main thread only.
+//
+
+#define SIMBENCH_STARS 1000000
+#define SIMBENCH_TICS 1000
+#define SIMBENCH_SEED 12345u
+
+static double R_SimPass(int count, int tics)
+{
+    m_rand_seed = SIMBENCH_SEED;
+    R_InitStars(count, world_w, world_h);
+
+    const Uint64 start = SDL_GetTicksNS();
+
+    for (int t = 0; t < tics; t++)
+        R_UpdateStars(count, world_w, world_h);
+
+    return (SDL_GetTicksNS() - start) / 1e9;
+}
+
+static int R_RunSimBenchmark(int count, int tics)
+{
+    star_t *const shown = stars;
+    size_t n = (size_t)MAX(count, MAXSTARS); // counter-based fields seek MAXSTARS at least
+    star_t *field;
+
+    // As many as memory allows
+    while (!(field = calloc(n, sizeof(*field))) && n > MAXSTARS)
+        n /= 2;
+    if (!field)
+    {
+        printf("simbench: out of memory\n");
+        return 1;
+    }
+    if (n < (size_t)count)
+    {
+        printf("simbench: only room for %zu stars\n", n);
+        count = (int)n;
+    }
+
+    stars = field;
+    if (COUNTER_RNG)
+        J_Init();
+    else if (RESPAWN_RING)
+        R_StartRespawnThread();
+
+    // Every update reads and writes every star once
+    const double bytes = 2.0 * sizeof(star_t) * count * tics;
+    const int threads = job_workers + 1;
+    double secs[2];
+
+    printf("simbench: %d stars (%.1f MB), %d tics, %s kernel\n", count,
+           (double)sizeof(star_t) * count / 1e6, tics,
+           COUNTER_RNG ? "counter" : RESPAWN_RING ? "respawn ring" : "classic");
+
+    secs[0] = R_SimPass(count, tics);
+
+    // Main thread only
+    if (job_workers)
+    {
+        J_Shutdown();
+        secs[1] = R_SimPass(count, tics);
+    }
+    else
+    {
+        secs[1] = secs[0];
+    }
+
+    for (int pass = 0; pass < (threads > 1 ? 2 : 1); pass++)
+    {
+        printf("%2d threads: %8.2f M updates/s  %7.2f GB/s\n", pass ? 1 : threads,
+               count * (double)tics / secs[pass] / 1e6, bytes / secs[pass] / 1e9);
+    }
+
+    // Only the counter kernel is split over the job threads
+    printf("scaling: %.2fx on %d threads, %.0f%% efficiency%s\n", secs[1] / secs[0], threads,
+           secs[1] / secs[0] / threads * 100, COUNTER_RNG ? "" : " (serial kernel)");
+
+    R_StopRespawnThread();
+    stars = shown;
+    free(field);
+    return 0;
+}
+
+//
+// Uniform grid over the star field, so every view only walks the stars
+// that can touch its rectangle. Rebuilt once per frame with a counting sort,
+// one grid per star field so a crossfade queries both without rebuilding.
+//
+
+#define GRID_CELL 128                     // cell size in pixels
+
+typedef struct
+{
+    int *start;                           // first index slot of each cell (+1 sentinel)
+    int index[MAXSTARS];                  // star indices ordered by cell
+} star_grid_t;
+
+static int grid_cols, grid_rows;
+static star_grid_t star_grids[2];         // per star_fields entry
+static int grid_cell[MAXSTARS];           // cell of every star, while building
+
+// The grid of the field in stars
+static star_grid_t *R_StarGrid(void)
+{
+    return &star_grids[stars == star_fields[1]];
+}
+
+static void R_FreeStarGrid(void)
+{
+    for (int f = 0; f < 2; f++)
+    {
+        free(star_grids[f].start);
+        star_grids[f].start = NULL;
+    }
+}
+
+static void R_InitStarGrid(int maxx, int maxy)
+{
+    R_FreeStarGrid();
+    grid_cols = MAX(1, (maxx + GRID_CELL - 1) / GRID_CELL);
+    grid_rows = MAX(1, (maxy + GRID_CELL - 1) / GRID_CELL);
+    for (int f = 0; f < 2; f++)
+        star_grids[f].start = calloc((size_t)grid_cols * grid_rows + 1, sizeof(int));
+}
+
+static void R_BuildStarGrid(int count)
+{
+    const int cells = grid_cols * grid_rows;
+    int *const grid_start = R_StarGrid()->start;
+    int *const grid_index = R_StarGrid()->index;
+
+    if (!grid_start)
+        return;
+
+    memset(grid_start, 0, (size_t)(cells + 1) * sizeof(*grid_start));
+
+    for (int i = 0; i < count; i++)
+    {
+        const int cx = BETWEEN(0, grid_cols - 1, (int)stars[i].x / GRID_CELL);
+        const int cy = BETWEEN(0, grid_rows - 1, (int)stars[i].y / GRID_CELL);
+        grid_cell[i] = cy * grid_cols + cx;
+        grid_start[grid_cell[i] + 1]++;
+    }
+
+    for (int c = 0; c < cells; c++)
+        grid_start[c + 1] += grid_start[c];
+
+    // Scatter, then shift the starts back (each was advanced past its cell)
+    for (int i = 0; i < count; i++)
+        grid_index[grid_start[grid_cell[i]]++] = i;
+
+    for (int c = cells; c > 0; c--)
+        grid_start[c] = grid_start[c - 1];
+    grid_start[0] = 0;
+}
+
+// Collect stars whose square (of the given size) overlaps the rectangle.
+static int R_QueryStarGrid(const SDL_Rect *rect, int size, int *out)
+{
+    const float x0 = (float)(rect->x - size), x1 = (float)(rect->x + rect->w);
+    const float y0 = (float)(rect->y - size), y1 = (float)(rect->y + rect->h);
+    const int cx0 = BETWEEN(0, grid_cols - 1, (int)floorf(x0 / GRID_CELL));
+    const int cx1 = BETWEEN(0, grid_cols - 1, (int)floorf(x1 / GRID_CELL));
+    const int cy0 = BETWEEN(0, grid_rows - 1, (int)floorf(y0 / GRID_CELL));
+    const int cy1 = BETWEEN(0, grid_rows - 1, (int)floorf(y1 / GRID_CELL));
+    const int *const grid_start = R_StarGrid()->start;
+    const int *const grid_index = R_StarGrid()->index;
+    int n = 0;
+
+    if (!grid_start)
+        return 0;
+
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        for (int c = cy * grid_cols + cx0; c <= cy * grid_cols + cx1; c++)
+        {
+            for (int j = grid_start[c]; j < grid_start[c + 1]; j++)
+            {
+                const star_t *st = &stars[grid_index[j]];
+
+                if (st->x > x0 && st->x < x1 && st->y > y0 && st->y < y1)
+                    out[n++] = grid_index[j];
+            }
+        }
+    }
+
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+// Panorama: a huge sky image, cut into mip-mapped tiles by -maketiles and
+// memory-mapped at run time, so only visible tiles are ever read
+// -----------------------------------------------------------------------------
+
+#define PANORAMA_FILENAME "panorama.sky"
+#define PANO_MAGIC "SKY1"
+#define PANO_TILE 256                     // tile side in pixels
+#define PANO_MAXLEVELS 16
+
+// Tiles across px screen pixels: the mip level keeps a texel within
+// sqrt(2) screen pixels, and a tile can be cut at both ends
+#define PANO_SPAN(px) ((int)((px) * 1.4143 / PANO_TILE) + 2)
+
+//
+// File: header, then every level's tiles row by row, each one a full
+// PANO_TILE square of XRGB8888 (edge tiles padded with black). Level n+1
+// is level n at half size, down to a single tile.
+//
+
+typedef struct
+{
+    char magic[4];
+    Uint32 width, height;                 // level 0 size
+    Uint32 tile;
+    Uint32 levels;
+} pano_header_t;
+
+typedef struct
+{
+    int w, h;                             // level size in pixels
+    int tiles_x, tiles_y;
+    Uint64 first;                         // index of the level's first tile
+} pano_level_t;
+
+typedef struct
+{
+    Uint32 key;                           // PANO_KEY, or PANO_NONE
+    Uint64 used;
+    Uint32 *pixels;
+} pano_slot_t;
+
+#define PANO_KEY(level, tx, ty) ((Uint32)(level) << 26 | (Uint32)(ty) << 13 | (Uint32)(tx))
+#define PANO_NONE 0xffffffffu
+
+static HANDLE pano_file, pano_map;
+static const Uint8 *pano_data;            // whole file, mapped
+static pano_header_t pano_hdr;
+static pano_level_t pano_levels[PANO_MAXLEVELS];
+static bool pano_failed;                  // don't retry a missing file every frame
+
+static pano_slot_t *pano_cpu;             // prefetched tiles, see R_SizePanoCaches
+static int pano_cpu_slots;
+static Uint32 *pano_requests;
+static int pano_num_requests, pano_max_requests;
+static Uint64 pano_clock;                 // CPU slot LRU stamps
+static Uint64 pano_gpu_clock;             // view texture LRU stamps, main thread only
+static SDL_Mutex *pano_lock;              // CPU slots and requests
+static SDL_Semaphore *pano_wake;
+static SDL_Thread *pano_thread;
+static SDL_AtomicInt pano_quit;
+
+static const Uint32 *R_PanoTile(Uint32 key)
+{
+    const int level = key >> 26, ty = (key >> 13) & 0x1fff, tx = key & 0x1fff;
+    const pano_level_t *l = &pano_levels[level];
+    const Uint64 index = l->first + (Uint64)ty * l->tiles_x + tx;
+
+    return (const Uint32 *)(pano_data + sizeof(pano_header_t) + index * PANO_TILE * PANO_TILE * 4);
+}
+
+// A hit counts as a use, so tiles still in demand aren't evicted
+static pano_slot_t *R_FindPanoSlot(Uint32 key)
+{
+    for (int i = 0; i < pano_cpu_slots; i++)
+    {
+        if (pano_cpu[i].key == key)
+        {
+            pano_cpu[i].used = ++pano_clock;
+            return &pano_cpu[i];
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Prefetch thread: copies requested tiles out of the mapping, so page
+// faults on the file happen here rather than on the render thread.
+//
+
+static int SDLCALL R_PanoThread(void *data)
+{
+    (void)data;
+
+    for (;;)
+    {
+        SDL_WaitSemaphore(pano_wake);
+
+        if (SDL_GetAtomicInt(&pano_quit))
+            return 0;
+
+        SDL_LockMutex(pano_lock);
+        while (pano_num_requests > 0)
+        {
+            const Uint32 key = pano_requests[--pano_num_requests];
+            int slot = 0;
+
+            if (R_FindPanoSlot(key))
+                continue;
+
+            for (int i = 1; i < pano_cpu_slots; i++)
+            {
+                if (pano_cpu[i].used < pano_cpu[slot].used)
+                    slot = i;
+            }
+
+            // Unlisted while being filled; by index, as R_SizePanoCaches
+            // may move the array meanwhile (the pixels stay put)
+            Uint32 *pixels = pano_cpu[slot].pixels;
+
+            pano_cpu[slot].key = PANO_NONE;
+            pano_cpu[slot].used = ++pano_clock;
+            SDL_UnlockMutex(pano_lock);
+
+            memcpy(pixels, R_PanoTile(key), PANO_TILE * PANO_TILE * 4);
+
+            SDL_LockMutex(pano_lock);
+            pano_cpu[slot].key = key;
+        }
+        SDL_UnlockMutex(pano_lock);
+    }
+}
+
+static void R_ClosePanorama(void)
+{
+    if (pano_thread)
+    {
+        SDL_SetAtomicInt(&pano_quit, 1);
+        SDL_SignalSemaphore(pano_wake);
+        SDL_WaitThread(pano_thread, NULL);
+        pano_thread = NULL;
+    }
+
+    for (int i = 0; i < pano_cpu_slots; i++)
+        free(pano_cpu[i].pixels);
+    free(pano_cpu);
+    free(pano_requests);
+    pano_cpu = NULL;
+    pano_requests = NULL;
+    pano_cpu_slots = pano_num_requests = pano_max_requests = 0;
+
+    if (pano_data)
+        UnmapViewOfFile(pano_data);
+    if (pano_map)
+        CloseHandle(pano_map);
+    if (pano_file && pano_file != INVALID_HANDLE_VALUE)
+        CloseHandle(pano_file);
+    if (pano_wake)
+        SDL_DestroySemaphore(pano_wake);
+    if (pano_lock)
+        SDL_DestroyMutex(pano_lock);
+
+    pano_data = NULL;
+    pano_map = pano_file = NULL;
+    pano_wake = NULL;
+    pano_lock = NULL;
+}
+
+static bool R_OpenPanorama(void)
+{
+    LARGE_INTEGER size;
+    Uint64 tiles = 0;
+
+    if (pano_data)
+        return true;
+    if (pano_failed)
+        return false;
+
+    pano_failed = true;
+    pano_file = CreateFileA(PANORAMA_FILENAME, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (pano_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(pano_file, &size)
+    || (Uint64)size.QuadPart < sizeof(pano_header_t))
+    {
+        LOG_Printf("Panorama: can't open %s", PANORAMA_FILENAME);
+        R_ClosePanorama();
+        return false;
+    }
+
+    pano_map = CreateFileMappingA(pano_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    pano_data = pano_map ? MapViewOfFile(pano_map, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!pano_data)
+    {
+        LOG_Printf("Panorama: MapViewOfFile failed: %lu", GetLastError());
+        R_ClosePanorama();
+        return false;
+    }
+
+    memcpy(&pano_hdr, pano_data, sizeof(pano_hdr));
+    if (memcmp(pano_hdr.magic, PANO_MAGIC, 4) || pano_hdr.tile != PANO_TILE
+    ||  !pano_hdr.levels || pano_hdr.levels > PANO_MAXLEVELS)
+    {
+        LOG_Printf("Panorama: %s is not a tile file", PANORAMA_FILENAME);
+        R_ClosePanorama();
+        return false;
+    }
+
+    for (Uint32 l = 0; l < pano_hdr.levels; l++)
+    {
+        pano_level_t *level = &pano_levels[l];
+
+        level->w = MAX(1, (int)(pano_hdr.width >> l));
+        level->h = MAX(1, (int)(pano_hdr.height >> l));
+        level->tiles_x = (level->w + PANO_TILE - 1) / PANO_TILE;
+        level->tiles_y = (level->h + PANO_TILE - 1) / PANO_TILE;
+        level->first = tiles;
+        tiles += (Uint64)level->tiles_x * level->tiles_y;
+    }
+
+    if (sizeof(pano_header_t) + tiles * PANO_TILE * PANO_TILE * 4 > (Uint64)size.QuadPart
+    ||  pano_levels[0].tiles_x > 8192 || pano_levels[0].tiles_y > 8192)
+    {
+        LOG_Printf("Panorama: %s is truncated", PANORAMA_FILENAME);
+        R_ClosePanorama();
+        return false;
+    }
+
+    pano_lock = SDL_CreateMutex();
+    pano_wake = SDL_CreateSemaphore(0);
+    SDL_SetAtomicInt(&pano_quit, 0);
+    pano_thread = SDL_CreateThread(R_PanoThread, "panorama", NULL);
+    if (!pano_thread)
+        LOG_Printf("SDL_CreateThread failed: %s", SDL_GetError());
+
+    pano_failed = false;
+    return true;
+}
+
+static void R_FreePanoTextures(view_t *view)
+{
+    for (int i = 0; i < view->pano_slots; i++)
+    {
+        if (view->pano_tex[i])
+            SDL_DestroyTexture(view->pano_tex[i]);
+    }
+
+    free(view->pano_tex);
+    free(view->pano_key);
+    free(view->pano_used);
+    view->pano_tex = NULL;
+    view->pano_key = NULL;
+    view->pano_used = NULL;
+    view->pano_slots = 0;
+}
+
+//
+// Cache sizes follow the views: a view keeps its visible tiles plus the
+// prefetch ring around them on the GPU, and the CPU slots hold every
+// view's ring. Worst case is a 4K view, about 300 tiles plus a ring of
+// 100. Caches only grow, on the first frame and when a view gets bigger.
+//
+
+static bool R_SizePanoCaches(view_t *view)
+{
+    const int cols = PANO_SPAN(view->rect.w), rows = PANO_SPAN(view->rect.h);
+    int cpu_slots = 0, requests = 0;
+
+    // Twice the side columns where the view straddles the wrap
+    view->pano_ring = 2 * cols + 4 * rows + 8;
+
+    if (view->pano_slots < cols * rows + view->pano_ring)
+    {
+        const int slots = cols * rows + view->pano_ring;
+
+        R_FreePanoTextures(view);
+        view->pano_tex = calloc(slots, sizeof(*view->pano_tex));
+        view->pano_key = malloc(slots * sizeof(*view->pano_key));
+        view->pano_used = calloc(slots, sizeof(*view->pano_used));
+        if (!view->pano_tex || !view->pano_key || !view->pano_used)
+        {
+            R_FreePanoTextures(view);
+            return false;
+        }
+
+        for (int i = 0; i < slots; i++)
+            view->pano_key[i] = PANO_NONE;
+        view->pano_slots = slots;
+    }
+
+    // Requests: one view's misses and ring at most, see R_DrawPanorama
+    for (int v = 0; v < num_views; v++)
+    {
+        cpu_slots += views[v].pano_ring;
+        requests = MAX(requests, views[v].pano_slots);
+    }
+
+    if (cpu_slots <= pano_cpu_slots && requests <= pano_max_requests)
+        return true;
+
+    SDL_LockMutex(pano_lock);
+
+    if (requests > pano_max_requests)
+    {
+        Uint32 *grown = realloc(pano_requests, requests * sizeof(*pano_requests));
+
+        if (grown)
+        {
+            pano_requests = grown;
+            pano_max_requests = requests;
+        }
+    }
+
+    if (cpu_slots > pano_cpu_slots)
+    {
+        pano_slot_t *grown = realloc(pano_cpu, cpu_slots * sizeof(*pano_cpu));
+
+        if (grown)
+        {
+            pano_cpu = grown;
+            while (pano_cpu_slots < cpu_slots)
+            {
+                pano_slot_t *slot = &pano_cpu[pano_cpu_slots];
+
+                slot->key = PANO_NONE;
+                slot->used = 0;
+                slot->pixels = malloc(PANO_TILE * PANO_TILE * 4);
+                if (!slot->pixels)
+                    break;
+                pano_cpu_slots++;
+            }
+        }
+    }
+
+    SDL_UnlockMutex(pano_lock);
+    return true;
+}
+
+static void R_RequestPanoTile(Uint32 key)
+{
+    if (pano_num_requests < pano_max_requests && !R_FindPanoSlot(key))
+        pano_requests[pano_num_requests++] = key;
+}
+
+//
+// The view's texture for a tile: from its LRU cache, else uploaded from
+// a prefetched copy. Never from the mapping: a cold page would stall the
+// frame, so a tile not prefetched yet is NULL (and asked for, if request).
+//
+
+static SDL_Texture *R_PanoTexture(view_t *view, Uint32 key, bool request)
+{
+    int slot = -1;
+
+    // Hit, else an unused texture, else the least recently used one
+    for (int i = 0; i < view->pano_slots; i++)
+    {
+        if (!view->pano_tex[i])
+        {
+            if (slot < 0 || view->pano_tex[slot])
+                slot = i;
+            continue;
+        }
+
+        if (view->pano_key[i] == key)
+        {
+            view->pano_used[i] = ++pano_gpu_clock;
+            return view->pano_tex[i];
+        }
+
+        if (slot < 0 || (view->pano_tex[slot] && view->pano_used[i] < view->pano_used[slot]))
+            slot = i;
+    }
+
+    if (slot < 0)
+        return NULL;
+
+    SDL_LockMutex(pano_lock);
+    const pano_slot_t *cpu = R_FindPanoSlot(key);
+    const Uint32 *pixels = cpu ? cpu->pixels : !pano_thread ? R_PanoTile(key) : NULL;  // no prefetch thread
+
+    if (!pixels && request)
+        R_RequestPanoTile(key);
+
+    if (pixels && !view->pano_tex[slot])
+    {
+        view->pano_tex[slot] = SDL_CreateTexture(view->renderer, SDL_PIXELFORMAT_XRGB8888,
+                                                 SDL_TEXTUREACCESS_STATIC, PANO_TILE, PANO_TILE);
+        if (view->pano_tex[slot])
+            SDL_SetTextureScaleMode(view->pano_tex[slot], SDL_SCALEMODE_LINEAR);
+    }
+
+    if (!pixels || !view->pano_tex[slot])
+    {
+        SDL_UnlockMutex(pano_lock);
+        return NULL;
+    }
+
+    SDL_UpdateTexture(view->pano_tex[slot], NULL, pixels, PANO_TILE * 4);
+    SDL_UnlockMutex(pano_lock);
+
+    view->pano_key[slot] = key;
+    view->pano_used[slot] = ++pano_gpu_clock;
+    return view->pano_tex[slot];
+}
+
+//
+// Idle task: upload one prefetched tile a view doesn't have yet, so
+// panning reaches tiles already on the GPU.
+//
+
+static bool R_UploadPanoTiles(void)
+{
+    if (!pano_data)
+        return false;
+
+    for (int v = 0; v < num_views; v++)
+    {
+        // pano_cpu_slots only changes on this thread
+        for (int i = 0; i < pano_cpu_slots; i++)
+        {
+            SDL_LockMutex(pano_lock);
+            const Uint32 key = pano_cpu[i].key;
+            SDL_UnlockMutex(pano_lock);
+
+            bool cached = key == PANO_NONE;
+
+            for (int j = 0; j < views[v].pano_slots && !cached; j++)
+                cached = views[v].pano_tex[j] && views[v].pano_key[j] == key;
+
+            if (!cached)
+            {
+                R_PanoTexture(&views[v], key, false);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+//
+// Panorama height fits the field height; it wraps around horizontally
+// and scrolls by PANORAMA_DRIFT. The mip level is the one closest to one
+// texel per screen pixel at the current zoom.
+//
+
+// Drift in level 0 pixels, wrapped to the panorama width so the float
+// keeps its precision however long the program runs
+static float R_PanoOffset(void)
+{
+    const Uint64 period = (Uint64)MAX(pano_hdr.width, 1) * 10;   // tenths of a pixel
+    const Uint64 steps = (gametic % period) * (Uint64)abs(PANORAMA_DRIFT) % period;
+
+    return (float)((PANORAMA_DRIFT < 0 ? -(double)steps : (double)steps) / 10.0);
+}
+
+static void R_DrawPanorama(view_t *view)
+{
+    if (!PANORAMA || world_h <= 0 || !R_OpenPanorama() || !R_SizePanoCaches(view))
+        return;
+
+    const double k = (double)pano_hdr.height / world_h;    // level 0 pixels per field unit
+    const double texel = k / zoom;                          // level 0 pixels per screen pixel
+    const int level = BETWEEN(0, (int)pano_hdr.levels - 1, (int)floor(log2(MAX(texel, 1e-6)) + 0.5));
+    const pano_level_t *l = &pano_levels[level];
+    const double scale = (double)(1 << level);              // level 0 pixels per level texel
+    const double fx = view->rect.x / zoom + cam_x;
+    const double fy = view->rect.y / zoom + cam_y;
+    const double offset = R_PanoOffset();
+
+    // Visible part, in level texels
+    const double u0 = (fx * k - offset) / scale, u1 = u0 + view->rect.w * texel / scale;
+    const double v0 = fy * k / scale, v1 = v0 + view->rect.h * texel / scale;
+    const int ty0 = MAX(0, (int)floor(v0 / PANO_TILE)), ty1 = MIN(l->tiles_y - 1, (int)floor(v1 / PANO_TILE));
+    const float tile_px = (float)(PANO_TILE * scale / texel);
+
+    SDL_LockMutex(pano_lock);
+    pano_num_requests = 0;
+    SDL_UnlockMutex(pano_lock);
+
+    for (double base = floor(u0 / l->w) * l->w; base < u1; base += l->w)
+    {
+        const int tx0 = MAX(0, (int)floor((u0 - base) / PANO_TILE));
+        const int tx1 = MIN(l->tiles_x - 1, (int)floor((u1 - base) / PANO_TILE));
+
+        // Neighbours of the visible block, for the next frames. Asked for
+        // first: the thread takes the latest requests first, so visible
+        // tiles missed below go ahead of them.
+        SDL_LockMutex(pano_lock);
+        for (int ty = ty0 - 1; ty <= ty1 + 1; ty++)
+        {
+            for (int tx = tx0 - 1; tx <= tx1 + 1; tx++)
+            {
+                const int wx = (tx + l->tiles_x) % l->tiles_x;
+
+                if (ty >= 0 && ty < l->tiles_y && (ty < ty0 || ty > ty1 || tx < tx0 || tx > tx1))
+                    R_RequestPanoTile(PANO_KEY(level, wx, ty));
+            }
+        }
+        SDL_UnlockMutex(pano_lock);
+
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            for (int tx = tx0; tx <= tx1; tx++)
+            {
+                SDL_Texture *tex = R_PanoTexture(view, PANO_KEY(level, tx, ty), true);
+                const int tw = MIN(PANO_TILE, l->w - tx * PANO_TILE);
+                const int th = MIN(PANO_TILE, l->h - ty * PANO_TILE);
+                SDL_FRect src = { 0, 0, (float)tw, (float)th };
+                const SDL_FRect dst = {
+                    (float)((base + tx * PANO_TILE - u0) * scale / texel),
+                    (float)((ty * PANO_TILE - v0) * scale / texel),
+                    tile_px * tw / PANO_TILE, tile_px * th / PANO_TILE
+                };
+
+                // Not prefetched yet: the part of a coarser tile at hand
+                // stands in, or nothing
+                for (int up = 1; !tex && level + up < (int)pano_hdr.levels && PANO_TILE >> up; up++)
+                {
+                    const int px = tx >> up, py = ty >> up, part = PANO_TILE >> up;
+
+                    tex = R_PanoTexture(view, PANO_KEY(level + up, px, py), false);
+                    src = (SDL_FRect){ (float)((tx - (px << up)) * part), (float)((ty - (py << up)) * part),
+                                       (float)tw / (1 << up), (float)th / (1 << up) };
+                }
+
+                if (tex)
+                    SDL_RenderTexture(view->renderer, tex, &src, &dst);
+            }
+        }
+    }
+
+    if (pano_thread)
+        SDL_SignalSemaphore(pano_wake);
+}
+
+//
+// -maketiles in.bmp out.sky: the offline half. Each level is the previous
+// one scaled down by two, written tile by tile.
+//
+
+static int R_MakeTiles(const char *in, const char *out)
+{
+    SDL_Surface *loaded = SDL_LoadBMP(in);
+    SDL_Surface *level = loaded ? SDL_ConvertSurface(loaded, SDL_PIXELFORMAT_XRGB8888) : NULL;
+    FILE *f = fopen(out, "wb");
+    Uint32 *tile = malloc(PANO_TILE * PANO_TILE * 4);
+    pano_header_t hdr = { { 'S', 'K', 'Y', '1' }, 0, 0, PANO_TILE, 1 };
+    bool ok = level && f && tile;
+
+    SDL_DestroySurface(loaded);
+
+    if (ok)
+    {
+        hdr.width = (Uint32)level->w;
+        hdr.height = (Uint32)level->h;
+        while (hdr.levels < PANO_MAXLEVELS && (MAX(hdr.width, hdr.height) >> (hdr.levels - 1)) > PANO_TILE)
+            hdr.levels++;
+        ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    }
+
+    for (Uint32 l = 0; ok && l < hdr.levels; l++)
+    {
+        if (l > 0)
+        {
+            SDL_Surface *half = SDL_ScaleSurface(level, MAX(1, (int)(hdr.width >> l)),
+                                                 MAX(1, (int)(hdr.height >> l)), SDL_SCALEMODE_LINEAR);
+            SDL_DestroySurface(level);
+            if (!(level = half))
+                break;
+        }
+
+        for (int ty = 0; ok && ty * PANO_TILE < level->h; ty++)
+        {
+            for (int tx = 0; ok && tx * PANO_TILE < level->w; tx++)
+            {
+                const int tw = MIN(PANO_TILE, level->w - tx * PANO_TILE);
+                const int th = MIN(PANO_TILE, level->h - ty * PANO_TILE);
+
+                memset(tile, 0, PANO_TILE * PANO_TILE * 4);
+                for (int y = 0; y < th; y++)
+                {
+                    memcpy(&tile[y * PANO_TILE],
+                           (const Uint8 *)level->pixels + (size_t)(ty * PANO_TILE + y) * level->pitch + tx * PANO_TILE * 4,
+                           (size_t)tw * 4);
+                }
+                ok = fwrite(tile, PANO_TILE * PANO_TILE * 4, 1, f) == 1;
+            }
+        }
+
+        printf("Level %u: %dx%d\n", (unsigned)l, level ? level->w : 0, level ? level->h : 0);
+    }
+
+    ok = ok && level;
+    if (!ok)
+        fprintf(stderr, "Failed to make %s from %s: %s\n", out, in, SDL_GetError());
+
+    SDL_DestroySurface(level);
+    free(tile);
+    if (f)
+        fclose(f);
+    return ok ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------------
+// Aurora
+// -----------------------------------------------------------------------------
+
+#define AURORA_DIV      2                 // aurora buffer is 1/2 of the render size
+#define AURORA_RIBBONS  3                 // number of layered curtains
+
+static Uint32 *aurora_pixels;             // XRGB8888 buffer (aurora_pitch * aurora_h)
+static float *aurora_cols;                // per-column top/slope/bottom of each ribbon
+static int aurora_w, aurora_h;            // buffer size
+static int aurora_pitch;                  // row length in pixels (multiple of 4)
+static Uint64 aurora_tic = (Uint64)-1;    // tic the buffer was built for
+static bool aurora_failed;                // out of memory or textures: skipped, AURORA kept
+
+static const float aurora_colors[AURORA_RIBBONS][3] =
+{
+    {  60.0f, 255.0f, 140.0f },           // green
+    {  40.0f, 190.0f, 255.0f },           // teal
+    { 170.0f,  80.0f, 255.0f },           // violet
+};
+
+static void R_FreeAurora(void)
+{
+    for (int v = 0; v < num_views; v++)
+    {
+        if (views[v].aurora_tex)
+            SDL_DestroyTexture(views[v].aurora_tex);
+        views[v].aurora_tex = NULL;
+    }
+    free(aurora_pixels);
+    free(aurora_cols);
+    aurora_pixels = NULL;
+    aurora_cols = NULL;
+    aurora_w = aurora_h = aurora_pitch = 0;
+}
+
+// Buffers only; every view makes its texture, see R_AuroraTexture
+static bool R_InitAurora(int w, int h)
+{
+    R_FreeAurora();
+
+    aurora_w = w;
+    aurora_h = h;
+    aurora_pitch = (w + 3) & ~3;
+    aurora_pixels = malloc((size_t)aurora_pitch * h * sizeof(*aurora_pixels));
+    aurora_cols = calloc((size_t)AURORA_RIBBONS * 3 * aurora_pitch, sizeof(*aurora_cols));
+    aurora_tic = (Uint64)-1;
+
+    if (!aurora_pixels || !aurora_cols)
+    {
+        R_FreeAurora();
+        return false;
+    }
+    return true;
+}
+
+//
+// A view's streaming texture covers only the part of the buffer the view
+// shows, so uploads don't grow with the number of views and a wide
+// spanned field doesn't need a texture wider than one display. Made again
+// when the view's part changes size.
+//
+
+static SDL_Texture *R_AuroraTexture(view_t *view)
+{
+    const int x0 = BETWEEN(0, aurora_w - 1, view->rect.x / AURORA_DIV);
+    const int y0 = BETWEEN(0, aurora_h - 1, view->rect.y / AURORA_DIV);
+    const int x1 = BETWEEN(x0 + 1, aurora_w, (view->rect.x + view->rect.w + AURORA_DIV - 1) / AURORA_DIV);
+    const int y1 = BETWEEN(y0 + 1, aurora_h, (view->rect.y + view->rect.h + AURORA_DIV - 1) / AURORA_DIV);
+    const SDL_Rect part = { x0, y0, x1 - x0, y1 - y0 };
+
+    if (view->aurora_tex && (part.w != view->aurora_rect.w || part.h != view->aurora_rect.h))
+    {
+        SDL_DestroyTexture(view->aurora_tex);
+        view->aurora_tex = NULL;
+    }
+
+    if (!view->aurora_tex)
+    {
+        view->aurora_tex = SDL_CreateTexture(view->renderer, SDL_PIXELFORMAT_XRGB8888,
+                                             SDL_TEXTUREACCESS_STREAMING, part.w, part.h);
+        if (!view->aurora_tex)
+        {
+            LOG_Printf("SDL_CreateTexture failed: %s", SDL_GetError());
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(view->aurora_tex, SDL_BLENDMODE_ADD);
+        SDL_SetTextureScaleMode(view->aurora_tex, SDL_SCALEMODE_LINEAR);
+        view->aurora_tic = (Uint64)-1;
+    }
+
+    if (part.x != view->aurora_rect.x || part.y != view->aurora_rect.y)
+        view->aurora_tic = (Uint64)-1;
+    view->aurora_rect = part;
+    return view->aurora_tex;
+}
+
+//
+// Shape of every curtain column for the current tic. Layered noise along x
+// gives the ribbon's top edge, length and intensity; within the column the
+// light ramps up linearly towards the sharp lower edge.
+//
+
+static void R_UpdateAuroraColumns(void)
+{
+    const float t = (float)gametic / TICRATE;
+
+    for (int k = 0; k < AURORA_RIBBONS; k++)
+    {
+        float *top    = aurora_cols + (k * 3 + 0) * aurora_pitch;
+        float *slope  = aurora_cols + (k * 3 + 1) * aurora_pitch;
+        float *bottom = aurora_cols + (k * 3 + 2) * aurora_pitch;
+        const float ofs = (float)k * 37.1f;
+
+        for (int x = 0; x < aurora_w; x++)
+        {
+            const float u = (float)x / (float)aurora_w;
+            const float curtain = BETWEEN(0.0f, 1.0f,
+                (M_FractalNoise1D(u * 3.0f + t * 0.04f * (k + 1) + ofs, 3) - 0.45f) * 3.0f);
+            const float flicker = 0.65f + 0.35f * M_Noise1D(u * 40.0f + t * 1.2f + ofs);
+            const float y0  = aurora_h * (0.05f + 0.3f * M_FractalNoise1D(u * 1.5f + t * 0.02f + ofs, 2));
+            const float len = aurora_h * (0.2f + 0.25f * M_Noise1D(u * 4.0f + t * 0.05f + ofs));
+
+            top[x] = y0;
+            bottom[x] = y0 + len;
+            slope[x] = curtain * flicker * 0.55f / len; // peak stays below 0.55
+        }
+
+        // Padding columns stay dark
+        for (int x = aurora_w; x < aurora_pitch; x++)
+            slope[x] = 0;
+    }
+}
+
+#ifndef R_SSE2
+static Uint32 R_AddSaturate(Uint32 a, Uint32 b)
+{
+    Uint32 out = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        const Uint32 c = ((a >> shift) & 0xff) + ((b >> shift) & 0xff);
+        out |= (c > 255 ? 255 : c) << shift;
+    }
+    return out;
+}
+#endif
+
+static void R_BuildAurora(void)
+{
+    memset(aurora_pixels, 0, (size_t)aurora_pitch * aurora_h * sizeof(*aurora_pixels));
+
+    for (int y = 0; y < aurora_h; y++)
+    {
+        Uint32 *row = aurora_pixels + y * aurora_pitch;
+        const float fy = (float)y;
+
+        for (int k = 0; k < AURORA_RIBBONS; k++)
+        {
+            const float *top    = aurora_cols + (k * 3 + 0) * aurora_pitch;
+            const float *slope  = aurora_cols + (k * 3 + 1) * aurora_pitch;
+            const float *bottom = aurora_cols + (k * 3 + 2) * aurora_pitch;
+            const float *color  = aurora_colors[k];
+
+#ifdef R_SSE2
+            // 4 columns at once: ramp, mask, pack to XRGB, saturating add
+            const __m128 vy = _mm_set1_ps(fy);
+            const __m128 vr = _mm_set1_ps(color[0]);
+            const __m128 vg = _mm_set1_ps(color[1]);
+            const __m128 vb = _mm_set1_ps(color[2]);
+
+            for (int x = 0; x < aurora_pitch; x += 4)
+            {
+                const __m128 t = _mm_loadu_ps(top + x);
+                const __m128 inside = _mm_and_ps(_mm_cmpge_ps(vy, t),
+                                                 _mm_cmplt_ps(vy, _mm_loadu_ps(bottom + x)));
+                const __m128 i4 = _mm_and_ps(inside, _mm_mul_ps(_mm_sub_ps(vy, t),
+                                                                _mm_loadu_ps(slope + x)));
+                const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(i4, vr));
+                const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(i4, vg));
+                const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(i4, vb));
+                const __m128i px = _mm_or_si128(_mm_slli_epi32(r, 16),
+                                                _mm_or_si128(_mm_slli_epi32(g, 8), b));
+                __m128i *dst = (__m128i *)(row + x);
+
+                _mm_storeu_si128(dst, _mm_adds_epu8(_mm_loadu_si128(dst), px));
+            }
+#else
+            for (int x = 0; x < aurora_w; x++)
+            {
+                if (fy < top[x] || fy >= bottom[x])
+                    continue;
+
+                const float i = (fy - top[x]) * slope[x];
+                const Uint32 px = ((Uint32)(i * color[0]) << 16)
+                                | ((Uint32)(i * color[1]) << 8)
+                                |  (Uint32)(i * color[2]);
+                row[x] = R_AddSaturate(row[x], px);
+            }
+#endif
+        }
+    }
+}
+
+static void R_DrawAurora(view_t *view)
+{
+    if (!AURORA || aurora_failed)
+        return;
+
+    // The buffer covers the whole star field, views show their part of it
+    const int w = MAX(1, world_w / AURORA_DIV);
+    const int h = MAX(1, world_h / AURORA_DIV);
+
+    if ((!aurora_pixels || w != aurora_w || h != aurora_h) && !R_InitAurora(w, h))
+    {
+        aurora_failed = true;
+        return;
+    }
+
+    SDL_Texture *tex = R_AuroraTexture(view);
+    const SDL_Rect *part = &view->aurora_rect;
+
+    if (!tex)
+    {
+        aurora_failed = true;
+        return;
+    }
+
+    // Curtains evolve once per tic; frames in between reuse the texture
+    if (aurora_tic != gametic)
+    {
+        R_UpdateAuroraColumns();
+        R_BuildAurora();
+        aurora_tic = gametic;
+    }
+
+    // The view's rows of the buffer, same pitch
+    if (view->aurora_tic != aurora_tic)
+    {
+        SDL_UpdateTexture(tex, NULL, aurora_pixels + (size_t)part->y * aurora_pitch + part->x,
+                          aurora_pitch * (int)sizeof(*aurora_pixels));
+        view->aurora_tic = aurora_tic;
+    }
+
+    const SDL_FRect src = { (float)view->rect.x / AURORA_DIV - part->x, (float)view->rect.y / AURORA_DIV - part->y,
+                            (float)view->rect.w / AURORA_DIV, (float)view->rect.h / AURORA_DIV };
+    SDL_SetTextureColorModFloat(tex, field_fade, field_fade, field_fade);
+    SDL_RenderTexture(view->renderer, tex, &src, NULL);
+}
+
+static SDL_FColor R_StarColor(const star_t *st)
+{
+    const int br = BETWEEN(0, 255, st->brightness);
+    SDL_FColor c = { br / 255.0f, br / 255.0f, br / 255.0f, 1.0f };
+
+    if (COLORED_STARS)
+    {
+        // scale base color by brightness
+        c.r = (float)((st->r * br) / 255) / 255.0f;
+        c.g = (float)((st->g * br) / 255) / 255.0f;
+        c.b = (float)((st->b * br) / 255) / 255.0f;
+    }
+
+    c.r *= field_fade;
+    c.g *= field_fade;
+    c.b *= field_fade;
+    return c;
+}
+
+//
+// Star shapes. Each shape and size has a precomputed table of spans
+// (rectangles relative to the star's corner, with a brightness factor),
+// so a fancy star costs a few quads instead of per-pixel tests.
+//
+
+enum { SHAPE_SQUARE, SHAPE_DISC, SHAPE_CROSS, SHAPE_SPIKES, NUMSHAPES };
+
+#define MAXSPANS 16                       // disc rows merge into at most MAXSIZE spans
+
+typedef struct
+{
+    float x, y, w, h;
+    float fade;                           // brightness factor
+} span_t;
+
+static span_t shape_spans[NUMSHAPES][MAXSIZE + 1][MAXSPANS];
+static int shape_nspans[NUMSHAPES][MAXSIZE + 1];
+
+static void R_AddSpan(int shape, int size, float x, float y, float w, float h, float fade)
+{
+    if (shape_nspans[shape][size] < MAXSPANS)
+        shape_spans[shape][size][shape_nspans[shape][size]++] = (span_t){ x, y, w, h, fade };
+}
+
+static void R_InitShapes(void)
+{
+    for (int size = 1; size <= MAXSIZE; size++)
+    {
+        const float s = (float)size;
+        const int   t = MAX(1, size / 3);                 // cross bar thickness
+        const float c = (float)((size - t) / 2);          // and offset
+        const int   ts = MAX(1, size / 6);                // spike thickness
+        const float cs = (float)((size - ts) / 2);        // and offset
+        const float len = s * 2;                          // spike length
+
+        R_AddSpan(SHAPE_SQUARE, size, 0, 0, s, s, 1.0f);
+
+        // Disc: one span per run of equally wide rows
+        for (int y = 0; y < size; y++)
+        {
+            const float dy = y + 0.5f - s / 2;
+            const float half = sqrtf(MAX(0.0f, s * s / 4 - dy * dy));
+            const float x0 = roundf(s / 2 - half);
+            const float x1 = MAX(x0 + 1, roundf(s / 2 + half));
+            const int n = shape_nspans[SHAPE_DISC][size];
+            span_t *last = n ? &shape_spans[SHAPE_DISC][size][n - 1] : NULL;
+
+            if (last && last->x == x0 && last->w == x1 - x0)
+                last->h += 1;
+            else
+                R_AddSpan(SHAPE_DISC, size, x0, (float)y, x1 - x0, 1, 1.0f);
+        }
+
+        // Plus-shaped cross
+        R_AddSpan(SHAPE_CROSS, size, 0, c, s, (float)t, 1.0f);
+        R_AddSpan(SHAPE_CROSS, size, c, 0, (float)t, s, 1.0f);
+
+        // Square core with four spikes, fading in two steps
+        R_AddSpan(SHAPE_SPIKES, size, 0, 0, s, s, 1.0f);
+        for (int k = 0; k < 2; k++)
+        {
+            const float near = k * len / 2, far = (k + 1) * len / 2;
+            const float fade = k ? 0.25f : 0.6f;
+
+            R_AddSpan(SHAPE_SPIKES, size, -far, cs, far - near, (float)ts, fade);
+            R_AddSpan(SHAPE_SPIKES, size, s + near, cs, far - near, (float)ts, fade);
+            R_AddSpan(SHAPE_SPIKES, size, cs, -far, (float)ts, far - near, fade);
+            R_AddSpan(SHAPE_SPIKES, size, cs, s + near, (float)ts, far - near, fade);
+        }
+    }
+}
+
+static int R_StarShape(const star_t *st)
+{
+    const int br = st->brightness;
+
+    if (br >= SHAPE_SPIKES_MIN) return SHAPE_SPIKES;
+    if (br >= SHAPE_CROSS_MIN)  return SHAPE_CROSS;
+    if (br >= SHAPE_DISC_MIN)   return SHAPE_DISC;
+    return SHAPE_SQUARE;
+}
+
+//
+// Stars are drawn as one geometry batch per size class: visible stars are
+// counting-sorted by size, then every class goes out in a single call
+// (split only if it overflows the vertex buffer).
+//
+
+#define BATCH_QUADS 4096
+
+static SDL_Vertex star_verts[BATCH_QUADS * 4];
+static int star_indices[BATCH_QUADS * 6]; // same two triangles for every quad
+static int batch_quads;
+static SDL_Texture *batch_texture;        // sprite of the current batch, if any
+
+static void R_FlushQuads(SDL_Renderer *renderer)
+{
+    if (batch_quads)
+        SDL_RenderGeometry(renderer, batch_texture, star_verts, batch_quads * 4, star_indices, batch_quads * 6);
+    batch_quads = 0;
+}
+
+//
+// Per-tile cost counters: fragments (covered pixels) and quads emitted
+// into each TILE_SIZE square of the primary window during the frame.
+//
+
+#ifdef R_TILESTATS
+
+#define TILE_SIZE 64
+#define MAXTILES_X 64
+#define MAXTILES_Y 40
+
+static bool show_tiles;
+static Uint32 tile_frags[MAXTILES_Y][MAXTILES_X];
+static Uint32 tile_quads[MAXTILES_Y][MAXTILES_X];
+
+static void R_CountTileCost(float x, float y, float w, float h)
+{
+    const float x1 = MAX(x, 0), y1 = MAX(y, 0);
+    const float x2 = MIN(x + w, MIN(render_w, TILE_SIZE * MAXTILES_X));
+    const float y2 = MIN(y + h, MIN(render_h, TILE_SIZE * MAXTILES_Y));
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    for (int ty = (int)y1 / TILE_SIZE; ty * TILE_SIZE < y2; ty++)
+    {
+        const float th = MIN(y2, (ty + 1) * TILE_SIZE) - MAX(y1, ty * TILE_SIZE);
+
+        for (int tx = (int)x1 / TILE_SIZE; tx * TILE_SIZE < x2; tx++)
+        {
+            const float tw = MIN(x2, (tx + 1) * TILE_SIZE) - MAX(x1, tx * TILE_SIZE);
+
+            tile_frags[ty][tx] += (Uint32)ceilf(tw * th);
+            tile_quads[ty][tx]++;
+        }
+    }
+}
+
+//
+// Tint every tile from blue (cheap) to red (the frame's worst tile),
+// label the three worst ones and reset the counters for the next frame.
+//
+
+static void R_DrawTileStats(void)
+{
+    if (!show_tiles)
+        return;
+
+    const int tiles_x = MIN((render_w + TILE_SIZE - 1) / TILE_SIZE, MAXTILES_X);
+    const int tiles_y = MIN((render_h + TILE_SIZE - 1) / TILE_SIZE, MAXTILES_Y);
+    int worst[3] = { -1, -1, -1 };
+    Uint32 total = 0, peak = 1;
+    char text[64];
+
+    for (int ty = 0; ty < tiles_y; ty++)
+    {
+        for (int tx = 0; tx < tiles_x; tx++)
+        {
+            const int t = ty * MAXTILES_X + tx;
+            const Uint32 f = tile_frags[ty][tx];
+
+            total += f;
+            peak = MAX(peak, f);
+
+            // Insert into the worst-three list
+            for (int k = 0; k < 3; k++)
+            {
+                if (worst[k] < 0 || f > tile_frags[worst[k] / MAXTILES_X][worst[k] % MAXTILES_X])
+                {
+                    for (int j = 2; j > k; j--)
+                        worst[j] = worst[j - 1];
+                    worst[k] = t;
+                    break;
+                }
+            }
+        }
+    }
+
+    SDL_SetRenderDrawBlendMode(sdl_renderer, SDL_BLENDMODE_BLEND);
+
+    for (int ty = 0; ty < tiles_y; ty++)
+    {
+        for (int tx = 0; tx < tiles_x; tx++)
+        {
+            const float heat = (float)tile_frags[ty][tx] / peak;
+            const SDL_FRect r = { (float)tx * TILE_SIZE, (float)ty * TILE_SIZE, TILE_SIZE - 1, TILE_SIZE - 1 };
+
+            SDL_SetRenderDrawColor(sdl_renderer, (Uint8)(255 * heat), 32, (Uint8)(255 * (1 - heat)),
+                                   (Uint8)(24 + 104 * heat));
+            SDL_RenderFillRect(sdl_renderer, &r);
+        }
+    }
+
+    SDL_SetRenderDrawColor(sdl_renderer, 255, 255, 200, 255);
+    for (int k = 0; k < 3 && worst[k] >= 0; k++)
+    {
+        const int tx = worst[k] % MAXTILES_X, ty = worst[k] / MAXTILES_X;
+
+        snprintf(text, sizeof(text), "#%d %u px %u q", k + 1,
+                 (unsigned)tile_frags[ty][tx], (unsigned)tile_quads[ty][tx]);
+        SDL_RenderDebugText(sdl_renderer, (float)tx * TILE_SIZE + 2, (float)ty * TILE_SIZE + 2, text);
+    }
+
+    snprintf(text, sizeof(text), "Tiles: %u px total, worst %u px (%.1fx mean)",
+             (unsigned)total, (unsigned)peak, (double)peak * tiles_x * tiles_y / MAX(total, 1));
+    SDL_RenderDebugText(sdl_renderer, 0, (float)render_h - 12, text);
+
+    SDL_SetRenderDrawBlendMode(sdl_renderer, SDL_BLENDMODE_NONE);
+    memset(tile_frags, 0, sizeof(tile_frags));
+    memset(tile_quads, 0, sizeof(tile_quads));
+}
+
+#endif
+
+static void R_EmitQuad(SDL_Renderer *renderer, float x, float y, float w, float h, SDL_FColor c)
+{
+    if (batch_quads == BATCH_QUADS)
+        R_FlushQuads(renderer);
+
+#ifdef R_TILESTATS
+    if (show_tiles && renderer == sdl_renderer)
+        R_CountTileCost(x, y, w, h);
+#endif
+
+    SDL_Vertex *v = &star_verts[batch_quads++ * 4];
+
+    v[0].position = (SDL_FPoint){ x, y };
+    v[1].position = (SDL_FPoint){ x + w, y };
+    v[2].position = (SDL_FPoint){ x + w, y + h };
+    v[3].position = (SDL_FPoint){ x, y + h };
+    v[0].tex_coord = (SDL_FPoint){ 0, 0 };
+    v[1].tex_coord = (SDL_FPoint){ 1, 0 };
+    v[2].tex_coord = (SDL_FPoint){ 1, 1 };
+    v[3].tex_coord = (SDL_FPoint){ 0, 1 };
+    for (int k = 0; k < 4; k++)
+        v[k].color = c;
+}
+
+//
+// A quad from (x0, y0) to (x1, y1), w wide, colored c0 at the first end
+// and c1 at the second; same vertex order as R_EmitQuad.
+//
+
+static void R_EmitStreak(SDL_Renderer *renderer, float x0, float y0, float x1, float y1, float w,
+                         SDL_FColor c0, SDL_FColor c1)
+{
+    const float dx = x1 - x0, dy = y1 - y0;
+    const float len = sqrtf(dx * dx + dy * dy);
+    const float nx = -dy / len * w / 2, ny = dx / len * w / 2;
+
+    if (batch_quads == BATCH_QUADS)
+        R_FlushQuads(renderer);
+
+#ifdef R_TILESTATS
+    if (show_tiles && renderer == sdl_renderer)
+        R_CountTileCost(MIN(x0, x1) - w / 2, MIN(y0, y1) - w / 2, fabsf(dx) + w, fabsf(dy) + w);
+#endif
+
+    SDL_Vertex *v = &star_verts[batch_quads++ * 4];
+
+    v[0].position = (SDL_FPoint){ x0 + nx, y0 + ny };
+    v[1].position = (SDL_FPoint){ x1 + nx, y1 + ny };
+    v[2].position = (SDL_FPoint){ x1 - nx, y1 - ny };
+    v[3].position = (SDL_FPoint){ x0 - nx, y0 - ny };
+    v[0].color = v[3].color = c0;
+    v[1].color = v[2].color = c1;
+    for (int k = 0; k < 4; k++)
+        v[k].tex_coord = (SDL_FPoint){ 0, 0 };
+}
+
+//
+// Star sprites for zoomed-in views: a solid core with a soft halo,
+// prerendered at 8, 16 ... SPRITE_MAX_SIDE pixels (a mip chain, one texture
+// per level) so a big star is never a magnified small image. Per renderer.
+//
+
+static void R_FreeSprites(view_t *view)
+{
+    R_FreePanoTextures(view);
+
+    if (view->scene)
+        SDL_DestroyTexture(view->scene);
+    view->scene = NULL;
+
+    for (int l = 0; l < SPRITE_LEVELS; l++)
+    {
+        if (view->sprites[l])
+            SDL_DestroyTexture(view->sprites[l]);
+        view->sprites[l] = NULL;
+    }
+}
+
+//
+// Render target for the stars: kept as the cached frame (STATIC_CACHE),
+// and smaller than the window when RENDER_SCALE is below 100%.
+// Recreated when the view or the scale changes.
+//
+
+static SDL_Texture *R_GetScene(view_t *view, float scale)
+{
+    const int w = MAX(1, (int)(view->rect.w * scale));
+    const int h = MAX(1, (int)(view->rect.h * scale));
+
+    if (view->scene && view->scene_w == w && view->scene_h == h)
+        return view->scene;
+
+    if (view->scene)
+        SDL_DestroyTexture(view->scene);
+
+    view->scene = SDL_CreateTexture(view->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w, h);
+    view->scene_w = w;
+    view->scene_h = h;
+    view->scene_valid = false;
+
+    if (!view->scene)
+        LOG_Printf("SDL_CreateTexture failed: %s", SDL_GetError());
+    else
+        SDL_SetTextureScaleMode(view->scene, SDL_SCALEMODE_LINEAR);
+
+    return view->scene;
+}
+
+static int R_SpriteLevel(float side)
+{
+    int level = 0;
+
+    while (level < SPRITE_LEVELS - 1 && (8 << level) < side)
+        level++;
+
+    return level;
+}
+
+static Uint32 *sprite_pixels[SPRITE_LEVELS];        // prebuilt by the idle worker
+static SDL_AtomicInt sprite_ready[SPRITE_LEVELS];
+static SDL_AtomicInt sprite_reach;                  // highest level worth prebuilding, -1 = none
+
+//
+// The levels the current zoom draws with and the next one up, so zooming
+// in finds them built; bigger ones wait until the zoom gets near them.
+// Sprites are only drawn above zoom 1.
+//
+
+static void R_ReachSprites(float z)
+{
+    SDL_SetAtomicInt(&sprite_reach, z * 2 > 1.0f ? R_SpriteLevel(MAXSIZE * z * 2 * 2) : -1);
+}
+
+static Uint32 *R_BuildSpritePixels(int level)
+{
+    const int n = 8 << level;
+    Uint32 *pixels = malloc((size_t)n * n * sizeof(*pixels));
+
+    if (!pixels)
+        return NULL;
+
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            // r: 0 at the center, 1 at the edge; core is the inner half
+            const float dx = (x + 0.5f) / n * 2 - 1, dy = (y + 0.5f) / n * 2 - 1;
+            const float r = sqrtf(dx * dx + dy * dy);
+            const float halo = (r - 0.5f) / 0.22f;
+            const float a = r <= 0.5f ? 1.0f : r >= 1.0f ? 0.0f : expf(-halo * halo);
+
+            pixels[y * n + x] = ((Uint32)(a * 255.0f + 0.5f) << 24) | 0xffffff;
+        }
+    }
+
+    return pixels;
+}
+
+// Idle worker task: one reachable level per slice, so zooming in doesn't
+// stall on it
+static bool R_PrebuildSprites(void)
+{
+    const int reach = SDL_GetAtomicInt(&sprite_reach);
+
+    for (int level = 0; level <= reach; level++)
+    {
+        if (!SDL_GetAtomicInt(&sprite_ready[level]))
+        {
+            sprite_pixels[level] = R_BuildSpritePixels(level);
+            SDL_SetAtomicInt(&sprite_ready[level], 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void R_FreeSpritePixels(void)
+{
+    for (int level = 0; level < SPRITE_LEVELS; level++)
+    {
+        free(sprite_pixels[level]);
+        sprite_pixels[level] = NULL;
+        SDL_SetAtomicInt(&sprite_ready[level], 0);
+    }
+}
+
+static SDL_Texture *R_GetSprite(view_t *view, float side)
+{
+    const int level = R_SpriteLevel(side);
+
+    if (!view->sprites[level])
+    {
+        const int n = 8 << level;
+        const bool ready = SDL_GetAtomicInt(&sprite_ready[level]) && sprite_pixels[level];
+        Uint32 *pixels = ready ? sprite_pixels[level] : R_BuildSpritePixels(level);
+
+        if (!pixels)
+            return NULL;
+
+        view->sprites[level] = SDL_CreateTexture(view->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                                 SDL_TEXTUREACCESS_STATIC, n, n);
+        if (view->sprites[level])
+        {
+            SDL_UpdateTexture(view->sprites[level], NULL, pixels, n * (int)sizeof(*pixels));
+            SDL_SetTextureBlendMode(view->sprites[level], SDL_BLENDMODE_BLEND);
+            SDL_SetTextureScaleMode(view->sprites[level], SDL_SCALEMODE_LINEAR);
+        }
+        if (!ready)
+            free(pixels);
+    }
+
+    return view->sprites[level];
+}
+
+static void R_DrawFieldStars(view_t *view)
+{
+    SDL_Renderer *const renderer = view->renderer;
+    static int visible[MAXSTARS];
+    static int sorted[MAXSTARS];
+    int bucket[MAXSIZE + 2] = { 0 };
+
+    // Only the part of the star field this view shows at the current zoom
+    // (plus the reach of spikes or halos) is walked
+    const int pad = SHAPE_SPIKES_MIN <= 255 || zoom > 1 ? STAR_SIZE * 2 : 0;
+    const float fx = view->rect.x / zoom + cam_x;
+    const float fy = view->rect.y / zoom + cam_y;
+    const SDL_Rect area = { (int)floorf(fx) - pad, (int)floorf(fy) - pad,
+                            (int)ceilf(view->rect.w / zoom) + 1 + pad * 2,
+                            (int)ceilf(view->rect.h / zoom) + 1 + pad * 2 };
+    const int count = R_QueryStarGrid(&area, STAR_SIZE + pad, visible);
+
+    if (!star_indices[1])
+    {
+        R_InitShapes();
+
+        for (int q = 0; q < BATCH_QUADS; q++)
+        {
+            int *idx = &star_indices[q * 6];
+            idx[0] = q * 4; idx[1] = q * 4 + 1; idx[2] = q * 4 + 2;
+            idx[3] = q * 4; idx[4] = q * 4 + 2; idx[5] = q * 4 + 3;
+        }
+    }
+
+    // Group visible stars by size class
+    for (int n = 0; n < count; n++)
+        bucket[R_StarSize(&stars[visible[n]]) + 1]++;
+    for (int size = 1; size <= MAXSIZE; size++)
+        bucket[size + 1] += bucket[size];
+    for (int n = 0; n < count; n++)
+        sorted[bucket[R_StarSize(&stars[visible[n]])]++] = visible[n];
+
+    // After the scatter, bucket[size - 1] is where class "size" starts.
+    // Every class is drawn one of three ways, by its size on screen:
+    //  - zoomed in: sprites from the mip chain
+    //  - below a pixel: points, dimmed by their coverage and added up
+    //  - otherwise: shape spans
+    for (int size = 1, first = 0; size <= MAXSIZE; size++)
+    {
+        const int last = bucket[size];
+        const float side = size * zoom;
+        const bool points = side < 1.0f;
+
+        batch_texture = zoom > 1.0f ? R_GetSprite(view, side * 2) : NULL;
+
+        // Streaks overlap their neighbours, and crossfading fields each
+        // other, so they add up like points
+        const bool additive = points || ((MOTION_BLUR || field_fade < 1.0f) && !batch_texture);
+        if (additive)
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_ADD);
+
+        for (int n = first; n < last; n++)
+        {
+            const star_t *st = &stars[sorted[n]];
+            const SDL_FColor c = R_StarColor(st);
+            const float x = (st->x - fx) * zoom, y = (st->y - fy) * zoom;
+
+            if (batch_texture)
+            {
+                R_EmitQuad(renderer, x - side / 2, y - side / 2, side * 2, side * 2, c);
+            }
+            else if (points)
+            {
+                const float a = side * side;
+                R_EmitQuad(renderer, floorf(x), floorf(y), 1, 1, (SDL_FColor){ c.r * a, c.g * a, c.b * a, 1.0f });
+            }
+            else if (MOTION_BLUR && (st->px != st->x || st->py != st->y)
+                 &&  fabsf(st->x - st->px) * zoom + fabsf(st->y - st->py) * zoom >= 1.0f)
+            {
+                // Head square, and a tail fading out towards where the star
+                // was a frame ago; dimmer the longer it gets, like a real
+                // exposure of a moving point
+                const float dx = (st->x - st->px) * zoom, dy = (st->y - st->py) * zoom;
+                const float len = sqrtf(dx * dx + dy * dy);
+                const float k = side / (side + len / 2);
+                const SDL_FColor head = { c.r * k, c.g * k, c.b * k, 1.0f };
+                const float hx = x + side / 2, hy = y + side / 2;
+
+                R_EmitStreak(renderer, hx - dx, hy - dy, hx, hy, side, (SDL_FColor){ 0, 0, 0, 1.0f }, head);
+                R_EmitQuad(renderer, x, y, side, side, head);
+            }
+            else
+            {
+                const int shape = R_StarShape(st);
+                const span_t *span = shape_spans[shape][size];
+
+                for (int k = 0; k < shape_nspans[shape][size]; k++, span++)
+                {
+                    const SDL_FColor sc = { c.r * span->fade, c.g * span->fade, c.b * span->fade, 1.0f };
+                    R_EmitQuad(renderer, x + span->x * zoom, y + span->y * zoom,
+                               span->w * zoom, span->h * zoom, sc);
+                }
+            }
+        }
+
+        R_FlushQuads(renderer);
+        if (additive)
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        first = last;
+    }
+
+    batch_texture = NULL;
+}
+
+static void R_DrawStarField(view_t *view)
+{
+    // Clear to black once per frame (SDL renderer is a backbuffer)
+    SDL_SetRenderDrawColor(view->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(view->renderer);
+
+    // Panorama goes behind the stars
+    R_DrawPanorama(view);
+
+    // Crossfade: two passes into the same target, the incoming field and
+    // its aurora first, then the shown one over it, their brightness adding
+    // up to one. Both grids were built in the update phase.
+    if (pl_fade_start)
+    {
+        PL_Swap();
+        field_fade = pl_fade;
+        R_DrawAurora(view);
+        R_DrawFieldStars(view);
+        PL_Swap();
+        field_fade = 1.0f - pl_fade;
+    }
+
+    R_DrawAurora(view);
+    R_DrawFieldStars(view);
+    field_fade = 1.0f;
+}
+
+//
+// Everything that shows in the star field, hashed. While it stays the
+// same, the cached scene is presented again instead of being redrawn.
+//
+
+static Uint32 frame_key;
+
+static Uint32 R_FrameKey(void)
+{
+    struct
+    {
+        Uint32 stars;
+        Uint64 aurora;
+        float zoom, cam_x, cam_y;
+        int w, h, views, scale, size, dist, falloff, shapes[3], tiles;
+        float pano;
+        int blur;
+        float fade;
+        int colored, step, flow;
+    } key;
+    const Uint8 *p = (const Uint8 *)&key;
+    Uint32 h = 2166136261u;
+
+    memset(&key, 0, sizeof(key));       // padding is hashed too
+    key.stars = R_HashStars(NUM_STARS);
+    key.aurora = AURORA && !aurora_failed ? gametic + 1 : 0;
+    key.zoom = zoom;
+    key.cam_x = cam_x;
+    key.cam_y = cam_y;
+    key.w = world_w;
+    key.h = world_h;
+    key.views = num_views;
+    key.scale = RENDER_SCALE;
+    key.size = STAR_SIZE;
+    key.dist = SIZE_DIST;
+    key.falloff = SIZE_FALLOFF;
+    key.shapes[0] = SHAPE_DISC_MIN;
+    key.shapes[1] = SHAPE_CROSS_MIN;
+    key.shapes[2] = SHAPE_SPIKES_MIN;
+    key.pano = PANORAMA ? R_PanoOffset() + 1 : 0;
+    key.blur = MOTION_BLUR;
+    key.fade = pl_fade_start ? pl_fade : -1.0f;
+    key.colored = COLORED_STARS;
+    key.step = BRIGHTNESS_STEP;
+    key.flow = FLOW_FIELD;
+#ifdef R_TILESTATS
+    key.tiles = show_tiles ? (int)SDL_GetTicks() : 0;   // counts need a real draw
+#endif
+
+    for (size_t i = 0; i < sizeof(key); i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+//
+// Stars go through the view's scene texture when it is cached or drawn
+// below full resolution; the render scale keeps coordinates in window
+// pixels either way.
+//
+
+static void R_DrawStars(view_t *view)
+{
+    SDL_Renderer *const renderer = view->renderer;
+    const float scale = RENDER_SCALE / 100.0f;
+    SDL_Texture *const scene = STATIC_CACHE || RENDER_SCALE < 100 ? R_GetScene(view, scale) : NULL;
+
+    if (!scene)
+    {
+        R_DrawStarField(view);
+        return;
+    }
+
+    if (!view->scene_valid || view->scene_key != frame_key)
+    {
+        SDL_SetRenderTarget(renderer, scene);
+        SDL_SetRenderScale(renderer, scale, scale);
+        R_DrawStarField(view);
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+
+        view->scene_key = frame_key;
+        view->scene_valid = true;
+    }
+
+    SDL_RenderTexture(renderer, scene, NULL, NULL);
+}
+
+static void R_DrawMessages(void)
+{
+    if (msg_text && msg_timeout)
+    {
+        SDL_SetRenderDrawColor(sdl_renderer, msg_r, msg_g, msg_b, msg_a);
+        SDL_SetRenderScale(sdl_renderer, 1.5f, 1.5f);
+        SDL_RenderDebugText(sdl_renderer, msg_x, msg_y, msg_text);
+        SDL_SetRenderScale(sdl_renderer, 1.0f, 1.0f);
+    }
+}
+
+static void R_DrawFPS(void)
+{
+    if (!SHOW_FPS)
+         return;
+
+    static int fps = 0;                 // current FPS to display
+    static int frame_count = 0;         // frame counter
+    static Uint64 last_fps_time = 0;    // time of last counter update
+    const  Uint64 now = SDL_GetTicks();
+    char   fps_text[32];
+
+    frame_count++;
+
+    static Uint64 last_cpu_time = 0;    // process CPU time at that update
+    static int cpu_per_sec = 0;         // ms of CPU time per second
+
+    if (now - last_fps_time >= 1000)    // update once per second
+    {
+        const Uint64 cpu = P_ProcessCPUTime();
+
+        // The first update only takes the baseline, the CPU time so far
+        // isn't this second's
+        if (last_fps_time)
+            cpu_per_sec = (int)((cpu - last_cpu_time) * 1000 / (now - last_fps_time));
+        last_cpu_time = cpu;
+        fps = frame_count;
+        frame_count = 0;
+        last_fps_time = now;
+        P_RollPhases();
+        I_RollIdleTasks();
+    }
+
+    snprintf(fps_text, sizeof(fps_text), "FPS: %d", fps);
+    SDL_SetRenderDrawColor(sdl_renderer, 96, 176, 255, 172);
+    SDL_SetRenderScale(sdl_renderer, 1.5f, 1.5f);
+    SDL_RenderDebugText(sdl_renderer, 0, 10, fps_text);
+    SDL_SetRenderScale(sdl_renderer, 1.0f, 1.0f);
+
+    // Per frame cost of every phase, and per star for the star work
+    const double freq = (double)SDL_GetPerformanceFrequency();
+    const int count = MAX(NUM_STARS, 1);
+    char phase_text[64];
+
+    for (int p = 0; p < NUMPHASES; p++)
+    {
+        const double ms = phase_last[p].ticks * 1000.0 / freq;
+
+        if (!phase_cycles)
+            snprintf(phase_text, sizeof(phase_text), "%-8s %6.2f ms", phase_names[p], ms);
+        else if (p == PH_UPDATE || p == PH_DRAW)
+            snprintf(phase_text, sizeof(phase_text), "%-8s %6.2f ms %7llu cyc/star", phase_names[p], ms,
+                     (unsigned long long)(phase_last[p].cycles / count));
+        else
+            snprintf(phase_text, sizeof(phase_text), "%-8s %6.2f ms %7llu kcyc", phase_names[p], ms,
+                     (unsigned long long)(phase_last[p].cycles / 1000));
+
+        SDL_RenderDebugText(sdl_renderer, 0, 32 + 10.0f * p, phase_text);
+    }
+
+    snprintf(phase_text, sizeof(phase_text), "%-8s %6d ms/s cpu", on_battery ? "battery" : "plugged", cpu_per_sec);
+    SDL_RenderDebugText(sdl_renderer, 0, 32 + 10.0f * NUMPHASES, phase_text);
+
+    // Idle tasks, in ms per second
+    for (int i = 0; i < num_idle_tasks; i++)
+    {
+        snprintf(phase_text, sizeof(phase_text), "%-12s %6.2f ms/s%s", idle_tasks[i].name,
+                 idle_tasks[i].last_us / 1000.0, idle_tasks[i].worker ? " (worker)" : "");
+        SDL_RenderDebugText(sdl_renderer, 0, 42 + 10.0f * (NUMPHASES + i), phase_text);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Input
+// -----------------------------------------------------------------------------
+
+static void I_ToggleFullScreen(bool enable)
+{
+    // Toggle fullscreen and handle cursor/screensaver
+    SDL_SetWindowFullscreen(sdl_window, enable); // SDL3 bool API
+    if (enable)
+    {
+        SDL_HideCursor();
+        SDL_DisableScreenSaver();
+    }
+    else
+    {
+        SDL_ShowCursor();
+        SDL_EnableScreenSaver();
+    }
+
+    // Update config variable
+    FULLSCREEN = enable;
+}
+
+//
+// Spanning mode: one borderless window per display, each showing its part
+// of a shared star field. Every column (row) of bezels between displays
+// adds BEZEL_GAP hidden pixels, so stars keep their pace behind the frames.
+// With only >= 0, the layout is the same but just that display gets a
+// window (one process per display, see lockstep).
+//
+
+static int I_CountGaps(const SDL_Rect *bounds, int count, int edge, bool vertical)
+{
+    int gaps = 0;
+
+    for (int j = 0; j < count; j++)
+    {
+        const int end = vertical ? bounds[j].y + bounds[j].h : bounds[j].x + bounds[j].w;
+        bool seen = false;
+
+        if (end > edge)
+            continue;
+
+        // Displays stacked along the same edge share one bezel
+        for (int k = 0; k < j; k++)
+            seen |= (vertical ? bounds[k].y + bounds[k].h : bounds[k].x + bounds[k].w) == end;
+
+        if (!seen)
+            gaps++;
+    }
+
+    return gaps;
+}
+
+static void I_ShutdownViews(void)
+{
+    for (int v = 0; v < num_views; v++)
+    {
+        R_FreeSprites(&views[v]);
+
+        if (views[v].renderer)
+            SDL_DestroyRenderer(views[v].renderer);
+        if (views[v].window)
+            SDL_DestroyWindow(views[v].window);
+        views[v].renderer = NULL;
+        views[v].window = NULL;
+    }
+    num_views = 0;
+}
+
+static bool I_InitSpanViews(int only)
+{
+    SDL_Rect bounds[MAXVIEWS];
+    int count = 0;
+    int minx = 0, miny = 0, maxx = 0, maxy = 0;
+    SDL_DisplayID *displays = SDL_GetDisplays(&count);
+
+    if (!displays || (only < 0 && count < 2) || only >= count)
+    {
+        SDL_free(displays);
+        return false;
+    }
+
+    count = BETWEEN(0, MAXVIEWS, count);
+    for (int i = 0; i < count; i++)
+    {
+        if (!SDL_GetDisplayBounds(displays[i], &bounds[i]))
+        {
+            SDL_Log("SDL_GetDisplayBounds failed: %s", SDL_GetError());
+            SDL_free(displays);
+            return false;
+        }
+    }
+    SDL_free(displays);
+
+    // Place displays in the field, with bezel gaps, and find its extent
+    for (int i = 0; i < count; i++)
+    {
+        SDL_Rect *r = &views[i].rect;
+
+        *r = bounds[i];
+        r->x += I_CountGaps(bounds, count, bounds[i].x, false) * BEZEL_GAP;
+        r->y += I_CountGaps(bounds, count, bounds[i].y, true) * BEZEL_GAP;
+
+        minx = i ? MIN(minx, r->x) : r->x;
+        miny = i ? MIN(miny, r->y) : r->y;
+        maxx = i ? MAX(maxx, r->x + r->w) : r->x + r->w;
+        maxy = i ? MAX(maxy, r->y + r->h) : r->y + r->h;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (only >= 0 && i != only)
+            continue;
+
+        view_t *view = &views[num_views];
+
+        *view = views[i];
+        view->rect.x -= minx;
+        view->rect.y -= miny;
+        num_views++;
+        view->window = SDL_CreateWindow("Starry Sky", bounds[i].w, bounds[i].h, SDL_WINDOW_BORDERLESS);
+        view->renderer = view->window ? SDL_CreateRenderer(view->window, NULL) : NULL;
+
+        if (!view->renderer)
+        {
+            SDL_Log("Spanning mode failed: %s", SDL_GetError());
+            I_ShutdownViews();
+            return false;
+        }
+
+        SDL_SetWindowPosition(view->window, bounds[i].x, bounds[i].y);
+        SDL_SetWindowFullscreen(view->window, true);
+    }
+
+    world_w = maxx - minx;
+    world_h = maxy - miny;
+
+    SDL_HideCursor();
+    SDL_DisableScreenSaver();
+    return true;
+}
+
+//
+// Window size changed (or first set up). With reset, the star field is
+// refitted to the window, unless its size is fixed by the display layout.
+//
+
+static void I_UpdateFieldSize(bool reset)
+{
+    SDL_GetRenderOutputSize(sdl_renderer, &render_w, &render_h); // pixels
+
+    if (!spanning)
+        views[0].rect = (SDL_Rect){ 0, 0, render_w, render_h };
+
+    if (reset)
+    {
+        if (!spanning)
+        {
+            world_w = render_w;
+            world_h = render_h;
+        }
+
+        R_InitStarGrid(world_w, world_h);
+        R_InitStars(NUM_STARS, world_w, world_h);
+
+        // An incoming field was made for the old size; PL_Update makes another
+        pl_fade_start = 0;
+        if (!SDL_CompareAndSwapAtomicInt(&pl_prewarm, PL_REQUESTED, PL_STALE))
+            SDL_CompareAndSwapAtomicInt(&pl_prewarm, PL_READY, PL_IDLE);
+    }
+}
+
+//
+// Zoom by factor, keeping the star field point under (sx, sy) in place.
+//
+
+static void I_ZoomAt(const view_t *view, float sx, float sy, float factor)
+{
+    const float new_zoom = BETWEEN(MIN_ZOOM, MAX_ZOOM, zoom * factor);
+    const float px = view->rect.x + sx, py = view->rect.y + sy;
+
+    // Star field point under the cursor, before and after
+    cam_x += px / zoom - px / new_zoom;
+    cam_y += py / zoom - py / new_zoom;
+    zoom = new_zoom;
+    R_ReachSprites(zoom);
+
+    snprintf(msg_buffer, sizeof(msg_buffer), "Zoom: %.2fx", zoom);
+}
+
+static view_t *I_ViewForWindow(SDL_WindowID id)
+{
+    for (int v = 0; v < num_views; v++)
+    {
+        if (SDL_GetWindowID(views[v].window) == id)
+            return &views[v];
+    }
+
+    return &views[0];
+}
+
+// TODO?
+// char stats[64];
+// R_DrawText(ren, "Starry Sky", 10, 10, 255, 255, 200, 255);
+// R_DrawText(ren, "F11: toggle fullscreen | SPACE: toggle colors", 10, 25, 180, 180, 255, 255);
+// R_DrawText(ren, stats, 10, 40, 200, 255, 200, 255);
+
+static void MSG_SetMessage(const char *message, int x, int y,
+                           int r, int g, int b, int a)
+{
+    msg_timeout = 4 * TICRATE;
+    msg_text = message;
+    msg_x = x; msg_y = y;
+    msg_r = r; msg_g = g; msg_b = b; msg_a = a;
+}
+
+//
+// Changes whenever the HUD on the primary view would look different.
+//
+
+static Uint32 I_HudKey(void)
+{
+    Uint32 h = (Uint32)(uintptr_t)msg_text * 31u;
+
+    h = (h ^ (msg_text && msg_timeout ? msg_timeout : 0)) * 31u;
+    h = (h ^ msg_a) * 31u;
+
+    // Overlays update their numbers once a second
+    if (SHOW_FPS)
+        h = (h ^ (Uint32)(SDL_GetTicks() / 1000 + 1)) * 31u;
+
+    return h;
+}
+
+
+// -----------------------------------------------------------------------------
+// Power profiles: lighter settings while the machine runs on battery
+// -----------------------------------------------------------------------------
+
+#define POWER_POLL_TICS (TICRATE * 5)     // power state checks
+#define POWER_RAMP 2                      // stars added or removed per tic
+
+typedef struct
+{
+    int delay_ms;
+    int num_stars;
+    int aurora;
+    int flow_field;
+    int render_scale;
+} power_profile_t;
+
+static power_profile_t plugged_profile;   // config values, back when plugged in
+static int star_target = -1;              // NUM_STARS ramps here, -1 = idle
+static Uint64 power_poll_tic;
+static Uint64 power_ramp_tic;
+
+static void PWR_Apply(bool battery)
+{
+    if (battery)
+    {
+        // Mid-ramp back from battery, the plugged count is the target
+        const int num_stars = star_target >= 0 ? star_target : NUM_STARS;
+
+        plugged_profile = (power_profile_t){ DELAY_MS, num_stars, AURORA, FLOW_FIELD, RENDER_SCALE };
+
+        DELAY_MS = BATTERY_DELAY_MS;
+        RENDER_SCALE = BATTERY_SCALE;
+        if (!BATTERY_EFFECTS)
+            AURORA = FLOW_FIELD = 0;
+        star_target = MIN(BATTERY_STARS, num_stars);
+    }
+    else
+    {
+        DELAY_MS = plugged_profile.delay_ms;
+        RENDER_SCALE = plugged_profile.render_scale;
+        AURORA = plugged_profile.aurora;
+        FLOW_FIELD = plugged_profile.flow_field;
+        star_target = plugged_profile.num_stars;
+    }
+
+    on_battery = battery;
+    MSG_SetMessage(battery ? "Power: battery profile" : "Power: plugged profile", 0, 0, 96, 176, 255, 255);
+    LOG_Printf("Power: switched to the %s profile", battery ? "battery" : "plugged");
+}
+
+//
+// Poll the power state now and then; the star count follows a switch
+// a few stars per tic, so the field thins out or fills in gradually.
+//
+
+static void PWR_Update(Uint64 tic)
+{
+    if (POWER_PROFILES && (tic >= power_poll_tic + POWER_POLL_TICS || !power_poll_tic))
+    {
+        const bool battery = SDL_GetPowerInfo(NULL, NULL) == SDL_POWERSTATE_ON_BATTERY;
 
-        if (STAR_SIZE > 1)
+        power_poll_tic = MAX(tic, 1);
+        if (battery != on_battery)
+            PWR_Apply(battery);
+    }
+    else if (!POWER_PROFILES && on_battery)
+    {
+        PWR_Apply(false);
+    }
+
+    if (star_target >= 0 && tic != power_ramp_tic)
+    {
+        const int step = MIN(abs(star_target - NUM_STARS), POWER_RAMP);
+
+        // Stars coming back enter as new ones
+        if (star_target > NUM_STARS)
         {
-            SDL_FRect r = { (float)stars[i].x, (float)stars[i].y, (float)STAR_SIZE, (float)STAR_SIZE };
-            SDL_RenderFillRect(sdl_renderer, &r);
+            for (int i = NUM_STARS; i < NUM_STARS + step; i++)
+                R_RespawnStar(i);
+        }
+
+        NUM_STARS += star_target > NUM_STARS ? step : -step;
+        power_ramp_tic = tic;
+        if (NUM_STARS == star_target)
+            star_target = -1;
+    }
+}
+
+//
+// Put the plugged-in values back, so the battery profile never ends up
+// in the config file; a ramp still running (back to the plugged count)
+// is finished at once.
+//
+
+static void PWR_Restore(void)
+{
+    if (on_battery)
+        PWR_Apply(false);
+
+    if (star_target >= 0)
+    {
+        NUM_STARS = star_target;
+        star_target = -1;
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+// Scene playlist: config scenes shown in turn, crossfading into each other.
+// The next scene's field is made on the idle worker ahead of time and its
+// sprites are uploaded in the slack between frames, so a switch costs no
+// more than drawing two fields for the length of the crossfade.
+// -----------------------------------------------------------------------------
+
+#define PL_LEAD_MS 2000                   // prewarm this long before a crossfade
+
+static const char *const scene_keys[] =
+{
+    "num_stars", "brightness_step", "colored_stars", "star_speed",
+    "star_size", "size_dist", "size_falloff",
+    "shape_disc_min", "shape_cross_min", "shape_spikes_min",
+    "aurora", "motion_blur",
+};
+
+static scene_params_t pl_base;            // config values, outside any scene
+static Uint64 pl_scene_start;             // ms
+static scene_params_t pl_prewarm_params;  // field the worker is asked for...
+static star_t *pl_prewarm_field;          // ...into this array
+static uint32_t pl_prewarm_seed;
+static int pl_prewarm_w, pl_prewarm_h;
+
+//
+// Scene lines are "seconds key=value ...", each on top of the config
+// values. The first scene starts at once.
+//
+
+static void PL_Init(void)
+{
+    PL_Get(&pl_base);
+
+    for (int i = 0; i < num_scenes; i++)
+    {
+        char buf[sizeof(scenes[0].text)];
+        char *end;
+
+        snprintf(buf, sizeof(buf), "%s", scenes[i].text);
+        scenes[i].seconds = BETWEEN(1, 86400, (int)strtol(buf, &end, 10));
+
+        for (char *tok = strtok(end, " \t"); tok; tok = strtok(NULL, " \t"))
+        {
+            char *eq = strchr(tok, '=');
+            bool known = false;
+
+            if (eq)
+            {
+                *eq = 0;
+                for (size_t k = 0; k < sizeof(scene_keys) / sizeof(scene_keys[0]) && !known; k++)
+                    known = ieq(tok, scene_keys[k]);
+            }
+
+            if (known)
+                ini_apply_kv(tok, eq + 1);
+            else
+                LOG_Printf("Scene %d: ignoring \"%s\"", i + 1, tok);
+        }
+
+        CFG_Check();
+        PL_Get(&scenes[i].params);
+        PL_Set(&pl_base);
+    }
+
+    if (num_scenes > 0)
+    {
+        pl_scene = 0;
+        pl_scene_start = SDL_GetTicks();
+        PL_Set(&scenes[0].params);
+    }
+}
+
+//
+// Idle worker task: the next scene's field, the way R_InitStars would
+// make it, over a private RNG state. The request is copied first; the
+// main thread only writes a new one once this one is done with.
+//
+
+static bool PL_PrewarmField(void)
+{
+    if (SDL_GetAtomicInt(&pl_prewarm) != PL_REQUESTED)
+        return false;
+
+    const scene_params_t params = pl_prewarm_params;
+    star_t *const field = pl_prewarm_field;
+    const int w = pl_prewarm_w, h = pl_prewarm_h;
+    uint32_t seed = pl_prewarm_seed;
+
+    for (int i = 0; i < params.num_stars; i++)
+    {
+        star_t *st = &field[i];
+
+        st->x = (float)(M_RandomFrom(&seed) % w);
+        st->y = (float)(M_RandomFrom(&seed) % h);
+        st->speed = 0.5f + ((M_RandomFrom(&seed) % 100) / 100.0f);
+        st->brightness = M_RandomFrom(&seed) % 256;
+        if (params.colored_stars)
+        {
+            st->r = (short)(M_RandomFrom(&seed) % 256);
+            st->g = (short)(M_RandomFrom(&seed) % 256);
+            st->b = (short)(M_RandomFrom(&seed) % 256);
         }
         else
         {
-            // 1x1 "pixel"
-            SDL_FRect r = { (float)stars[i].x, (float)stars[i].y, 1.0f, 1.0f };
-            SDL_RenderFillRect(sdl_renderer, &r);
+            st->r = st->g = st->b = (short)(M_RandomFrom(&seed) % 256);
+        }
+        st->size_r = (short)(params.size_dist ? M_RandomFrom(&seed) : 0);
+        st->px = st->x;
+        st->py = st->y;
+        st->pb = st->brightness;
+    }
+
+    // Publishes the field (full barrier), unless the request went stale
+    if (!SDL_CompareAndSwapAtomicInt(&pl_prewarm, PL_REQUESTED, PL_READY))
+        SDL_SetAtomicInt(&pl_prewarm, PL_IDLE);
+    return true;
+}
+
+// Idle task: the aurora buffers and textures and the sprite textures the
+// next scene needs, one a slice
+static bool PL_PrewarmTextures(void)
+{
+    if (SDL_GetAtomicInt(&pl_prewarm) != PL_READY)
+        return false;
+
+    // Same size test as R_DrawAurora, so its first frame finds them ready
+    if (pl_prewarm_params.aurora)
+    {
+        const int w = MAX(1, world_w / AURORA_DIV);
+        const int h = MAX(1, world_h / AURORA_DIV);
+
+        if (!aurora_pixels || w != aurora_w || h != aurora_h)
+        {
+            R_InitAurora(w, h);
+            return true;
+        }
+
+        for (int v = 0; v < num_views && aurora_pixels; v++)
+        {
+            if (!views[v].aurora_tex && R_AuroraTexture(&views[v]))
+                return true;
+        }
+    }
+
+    if (zoom <= 1.0f)
+        return false;
+
+    for (int v = 0; v < num_views; v++)
+    {
+        for (int size = 1; size <= pl_prewarm_params.star_size; size++)
+        {
+            const float side = size * zoom * 2;
+
+            if (!views[v].sprites[R_SpriteLevel(side)])
+            {
+                R_GetSprite(&views[v], side);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+//
+// Once a frame, before the updates: asks for the next field ahead of
+// time, starts the crossfade when it's due and ready, and hands over to
+// the new field at its end. The playlist holds while the battery profile
+// is in charge of the star count.
+//
+
+static void PL_Update(void)
+{
+    if (pl_scene < 0 || num_scenes < 2)
+        return;
+
+    const Uint64 now = SDL_GetTicks();
+    const int next = (pl_scene + 1) % num_scenes;
+
+    // Counter-based fields are seekable, an extra field wouldn't be
+    if (!pl_fade_start && !on_battery && star_target < 0 && !COUNTER_RNG)
+    {
+        const Uint64 length = scenes[pl_scene].seconds * 1000ull;
+        const Uint64 fade_at = pl_scene_start + length - MIN((Uint64)SCENE_FADE_MS, length);
+        const int state = SDL_GetAtomicInt(&pl_prewarm);
+
+        if (state == PL_IDLE && now + PL_LEAD_MS >= fade_at)
+        {
+            pl_prewarm_params = scenes[next].params;
+            pl_prewarm_field = back_stars;
+            pl_prewarm_seed = (uint32_t)M_RealRandom() << 15 ^ (uint32_t)M_RealRandom();
+            pl_prewarm_w = MAX(1, world_w);
+            pl_prewarm_h = MAX(1, world_h);
+            SDL_SetAtomicInt(&pl_prewarm, PL_REQUESTED);
+        }
+        else if (state == PL_READY && (pl_prewarm_w != world_w || pl_prewarm_h != world_h))
+        {
+            SDL_SetAtomicInt(&pl_prewarm, PL_IDLE);
+        }
+        else if (state == PL_READY && now >= fade_at)
+        {
+            pl_incoming = scenes[next].params;
+            pl_fade_start = MAX(now, 1);
+        }
+    }
+
+    if (pl_fade_start)
+    {
+        pl_fade = SCENE_FADE_MS ? (float)(now - pl_fade_start) / SCENE_FADE_MS : 1.0f;
+        if (pl_fade < 1.0f)
+            return;
+
+        // The incoming field is the one shown from now on
+        PL_Swap();
+        pl_fade_start = 0;
+        pl_scene = next;
+        pl_scene_start = now;
+        SDL_SetAtomicInt(&pl_prewarm, PL_IDLE);
+        LOG_Printf("Playlist: scene %d", pl_scene + 1);
+    }
+}
+
+// While crossfading, the incoming field moves too, and gets its own grid
+static void PL_UpdateIncoming(void)
+{
+    if (!pl_fade_start)
+        return;
+
+    PL_Swap();
+    if (MOTION_BLUR)
+        R_SaveMotion(NUM_STARS);
+    R_UpdateStars(NUM_STARS, world_w, world_h);
+    if (MOTION_BLUR)
+        R_EndMotion(NUM_STARS, world_w, world_h);
+    R_BuildStarGrid(NUM_STARS);
+    PL_Swap();
+}
+
+//
+// Config values back, so the config file gets them and not a scene's.
+//
+
+static void PL_Restore(void)
+{
+    if (pl_scene >= 0)
+    {
+        pl_fade_start = 0;
+        PL_Set(&pl_base);
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+// Frame export: shared-memory ring of finished frames for other processes
+// -----------------------------------------------------------------------------
+
+#define EXPORT_NAME   "Local\\StarrySkyFrames"
+#define EXPORT_EVENT  "Local\\StarrySkyFrameReady"
+#define EXPORT_MAGIC  0x53545246          // "FRTS"
+#define EXPORT_SLOTS  3
+
+//
+// Each slot is guarded by a sequence number, odd while the writer is
+// filling it. Readers check it before and after looking at the pixels;
+// a change means the frame was overwritten under them.
+//
+
+typedef struct
+{
+    volatile LONG64 seq;                  // odd while being written
+    uint64_t frame;                       // frame number
+    uint64_t timestamp;                   // SDL_GetPerformanceCounter at capture
+    int32_t  w, h;                        // frame size, pitch is w * 4
+    uint32_t checksum;                    // EX_Checksum of the pixels
+    uint32_t pad;
+} export_slot_t;
+
+typedef struct
+{
+    uint32_t magic;
+    int32_t  max_w, max_h;                // slot capacity
+    int32_t  slots;
+    uint64_t slot_offset;                 // start of the first slot's pixels
+    uint64_t slot_bytes;                  // pixel bytes per slot
+    volatile LONG64 latest;               // newest complete frame number
+    export_slot_t slot[EXPORT_SLOTS];
+} export_header_t;
+
+static HANDLE export_map;
+static HANDLE export_event;
+static export_header_t *export_hdr;       // NULL when not exporting
+static uint64_t export_frame;
+
+static Uint8 *EX_SlotPixels(export_header_t *hdr, int i)
+{
+    return (Uint8 *)hdr + hdr->slot_offset + (uint64_t)i * hdr->slot_bytes;
+}
+
+// Fletcher-style sum over 32-bit words, cheap enough for every frame
+static uint32_t EX_Checksum(const Uint32 *p, size_t words)
+{
+    uint32_t a = 1, b = 0;
+
+    for (size_t i = 0; i < words; i++)
+    {
+        a += p[i];
+        b += a;
+    }
+
+    return a ^ (b << 7 | b >> 25);
+}
+
+static bool EX_Init(int max_w, int max_h)
+{
+    const uint64_t slot_bytes = (uint64_t)max_w * max_h * 4;
+    const uint64_t offset = (sizeof(export_header_t) + 4095) & ~(uint64_t)4095;
+    const uint64_t size = offset + slot_bytes * EXPORT_SLOTS;
+
+    export_map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                    (DWORD)(size >> 32), (DWORD)size, EXPORT_NAME);
+    export_event = CreateEventA(NULL, FALSE, FALSE, EXPORT_EVENT);
+
+    if (!export_map || !export_event
+     || !(export_hdr = MapViewOfFile(export_map, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)size)))
+    {
+        SDL_Log("Frame export failed: %lu", GetLastError());
+        if (export_map)
+            CloseHandle(export_map);
+        if (export_event)
+            CloseHandle(export_event);
+        export_map = export_event = NULL;
+        return false;
+    }
+
+    export_hdr->max_w = max_w;
+    export_hdr->max_h = max_h;
+    export_hdr->slots = EXPORT_SLOTS;
+    export_hdr->slot_offset = offset;
+    export_hdr->slot_bytes = slot_bytes;
+    InterlockedExchange64(&export_hdr->latest, -1);
+    InterlockedExchange((volatile LONG *)&export_hdr->magic, EXPORT_MAGIC);
+    return true;
+}
+
+static void EX_Shutdown(void)
+{
+    if (export_hdr)
+        UnmapViewOfFile(export_hdr);
+    if (export_map)
+        CloseHandle(export_map);
+    if (export_event)
+        CloseHandle(export_event);
+    export_hdr = NULL;
+    export_map = export_event = NULL;
+}
+
+//
+// Read back the renderer's current target as ARGB8888.
+//
+
+static SDL_Surface *I_ReadPixels(SDL_Renderer *renderer)
+{
+    SDL_Surface *surf = SDL_RenderReadPixels(renderer, NULL);
+
+    if (surf && surf->format != SDL_PIXELFORMAT_ARGB8888)
+    {
+        SDL_Surface *conv = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_ARGB8888);
+        SDL_DestroySurface(surf);
+        surf = conv;
+    }
+
+    return surf;
+}
+
+static void EX_ExportFrame(SDL_Renderer *renderer)
+{
+    SDL_Surface *surf = I_ReadPixels(renderer);
+
+    if (!surf)
+        return;
+
+    if (surf->w <= export_hdr->max_w && surf->h <= export_hdr->max_h)
+    {
+        const int i = (int)(export_frame % EXPORT_SLOTS);
+        export_slot_t *slot = &export_hdr->slot[i];
+        Uint32 *dst = (Uint32 *)EX_SlotPixels(export_hdr, i);
+
+        InterlockedIncrement64(&slot->seq); // odd: writing
+
+        for (int y = 0; y < surf->h; y++)
+            memcpy(dst + (size_t)y * surf->w, (Uint8 *)surf->pixels + (size_t)y * surf->pitch, (size_t)surf->w * 4);
+
+        slot->frame = export_frame;
+        slot->timestamp = SDL_GetPerformanceCounter();
+        slot->w = surf->w;
+        slot->h = surf->h;
+        slot->checksum = EX_Checksum(dst, (size_t)surf->w * surf->h);
+
+        InterlockedIncrement64(&slot->seq); // even: complete
+        InterlockedExchange64(&export_hdr->latest, (LONG64)export_frame);
+        SetEvent(export_event);
+        export_frame++;
+    }
+
+    SDL_DestroySurface(surf);
+}
+
+//
+// Reference consumer (-exportreader). Validates every frame in place,
+// straight from the mapping, and prints rate and latency once a second.
+//
+
+static int EX_RunReader(void)
+{
+    HANDLE map = OpenFileMappingA(FILE_MAP_READ, FALSE, EXPORT_NAME);
+    HANDLE event = OpenEventA(SYNCHRONIZE, FALSE, EXPORT_EVENT);
+    const export_header_t *hdr = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (!hdr || !event || hdr->magic != EXPORT_MAGIC)
+    {
+        fprintf(stderr, "No frame export found (start stars with -export)\n");
+        return 1;
+    }
+
+    const double freq = (double)SDL_GetPerformanceFrequency();
+    Uint64 last_report = SDL_GetTicks();
+    LONG64 last = -1;
+    int frames = 0, torn = 0, corrupt = 0, missed = 0;
+    double lat_sum = 0, lat_max = 0;
+
+    for (;;)
+    {
+        WaitForSingleObject(event, 100);
+
+        const LONG64 latest = InterlockedCompareExchange64((volatile LONG64 *)&hdr->latest, 0, 0);
+
+        if (latest >= 0 && latest != last)
+        {
+            const int i = (int)(latest % hdr->slots);
+            const export_slot_t *slot = &hdr->slot[i];
+            const LONG64 seq = InterlockedCompareExchange64((volatile LONG64 *)&slot->seq, 0, 0);
+            const uint64_t stamp = slot->timestamp;
+            const uint32_t sum = EX_Checksum((const Uint32 *)EX_SlotPixels((export_header_t *)hdr, i),
+                                             (size_t)slot->w * slot->h);
+
+            if ((seq & 1) || seq != InterlockedCompareExchange64((volatile LONG64 *)&slot->seq, 0, 0))
+            {
+                torn++;
+            }
+            else
+            {
+                const double lat = (double)(SDL_GetPerformanceCounter() - stamp) * 1000.0 / freq;
+
+                if (sum != slot->checksum)
+                    corrupt++;
+                if (last >= 0 && latest > last + 1)
+                    missed += (int)(latest - last - 1);
+
+                lat_sum += lat;
+                lat_max = MAX(lat_max, lat);
+                frames++;
+            }
+            last = latest;
+        }
+
+        if (SDL_GetTicks() - last_report >= 1000)
+        {
+            printf("%d fps, latency avg %.2f ms max %.2f ms, %d torn, %d corrupt, %d missed\n",
+                   frames, frames ? lat_sum / frames : 0.0, lat_max, torn, corrupt, missed);
+            fflush(stdout);
+            frames = torn = corrupt = missed = 0;
+            lat_sum = lat_max = 0;
+            last_report = SDL_GetTicks();
+        }
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+// Screenshots: captured on the render thread, written by a background one
+// -----------------------------------------------------------------------------
+
+static SDL_Thread *shot_thread;
+static SDL_Semaphore *shot_request;       // signalled when shot_surface is ready
+static SDL_AtomicInt shot_busy;           // 1 while the writer owns shot_surface
+static SDL_AtomicInt shot_done;           // 1 when shot_result is ready to show
+static SDL_AtomicInt shot_quit;
+static SDL_Surface *shot_surface;         // read back frame, freed by the writer
+static Uint64 shot_copy_us;               // render thread's share of the capture
+static char shot_result[64];              // message for MSG_SetMessage
+static bool shot_pending;                 // F12 pressed, capture this frame
+
+static int SDLCALL SS_WriterThread(void *data)
+{
+    (void)data;
+
+    for (;;)
+    {
+        SDL_WaitSemaphore(shot_request);
+
+        if (SDL_GetAtomicInt(&shot_quit))
+            return 0;
+
+        const Uint64 start = SDL_GetTicks();
+        char name[32];
+        SDL_Surface *surf = shot_surface;
+
+        // First free stars_NNNN.bmp
+        for (int n = 0; n < 10000; n++)
+        {
+            FILE *f;
+
+            snprintf(name, sizeof(name), "stars_%04d.bmp", n);
+            if (!(f = fopen(name, "rb")))
+                break;
+            fclose(f);
         }
+
+        if (SDL_SaveBMP(surf, name))
+            snprintf(shot_result, sizeof(shot_result), "%s (%llu us + %llu ms)", name,
+                     (unsigned long long)shot_copy_us, (unsigned long long)(SDL_GetTicks() - start));
+        else
+        {
+            snprintf(shot_result, sizeof(shot_result), "Screenshot failed");
+            LOG_Printf("Screenshot %s failed: %s", name, SDL_GetError());
+        }
+
+        SDL_DestroySurface(surf);
+        shot_surface = NULL;
+        SDL_SetAtomicInt(&shot_done, 1);
+        SDL_SetAtomicInt(&shot_busy, 0);
+    }
+}
+
+// Writer thread, started with the windows so F12 never waits for it
+static void SS_Init(void)
+{
+    shot_request = SDL_CreateSemaphore(0);
+    shot_thread = shot_request ? SDL_CreateThread(SS_WriterThread, "screenshot", NULL) : NULL;
+    if (!shot_thread)
+        LOG_Printf("Screenshots: SDL_CreateThread failed: %s", SDL_GetError());
+}
+
+//
+// The read back surface goes to the writer as is; the render thread's
+// cost is the read back alone.
+//
+
+static void SS_Capture(SDL_Renderer *renderer)
+{
+    if (!shot_thread)
+        return;
+
+    if (SDL_GetAtomicInt(&shot_busy))
+    {
+        MSG_SetMessage("Screenshot in progress", 0, 0, 96, 176, 255, 255);
+        return;
     }
+
+    const Uint64 start = SDL_GetTicksNS();
+    SDL_Surface *surf = I_ReadPixels(renderer);
+
+    if (!surf)
+        return;
+
+    shot_surface = surf;
+    shot_copy_us = (SDL_GetTicksNS() - start) / 1000;
+    SDL_SetAtomicInt(&shot_busy, 1);
+    SDL_SignalSemaphore(shot_request);
 }
 
-static void R_DrawMessages(void)
+static void SS_Shutdown(void)
 {
-    if (msg_text && msg_timeout)
+    if (shot_thread)
     {
-        SDL_SetRenderDrawColor(sdl_renderer, msg_r, msg_g, msg_b, msg_a);
-        SDL_SetRenderScale(sdl_renderer, 1.5f, 1.5f);
-        SDL_RenderDebugText(sdl_renderer, msg_x, msg_y, msg_text);
-        SDL_SetRenderScale(sdl_renderer, 1.0f, 1.0f);
+        SDL_SetAtomicInt(&shot_quit, 1);
+        SDL_SignalSemaphore(shot_request);
+        SDL_WaitThread(shot_thread, NULL);
+        shot_thread = NULL;
     }
+    if (shot_request)
+        SDL_DestroySemaphore(shot_request);
+    shot_request = NULL;
 }
 
-static void R_DrawFPS(void)
+
+// -----------------------------------------------------------------------------
+// Profiler: samples the main thread's instruction pointer from a helper
+// thread (-profile [N]) and prints the top N functions at exit
+// -----------------------------------------------------------------------------
+
+#define PROF_SAMPLES (1 << 20)
+#define PROF_INTERVAL_MS 1
+
+typedef struct
 {
-    if (!SHOW_FPS)
-         return;
+    DWORD64 ip;
+    int phase;
+} prof_sample_t;
 
-    static int fps = 0;                 // current FPS to display
-    static int frame_count = 0;         // frame counter
-    static Uint64 last_fps_time = 0;    // time of last counter update
-    const  Uint64 now = SDL_GetTicks();
-    char   fps_text[32];
+typedef struct
+{
+    DWORD64 addr;                         // function start, or the address itself
+    char name[64];
+    int count;
+    int phases[NUMPHASES];
+} prof_entry_t;
 
-    frame_count++;
+static SDL_Thread *prof_thread;
+static SDL_AtomicInt prof_quit;
+static HANDLE prof_target;                // main thread, for Suspend/GetThreadContext
+static prof_sample_t *prof_samples;
+static int prof_count;                    // written by the sampler only
+static int prof_top;
+static Uint64 prof_elapsed_ns;            // sampling time, for the real interval
 
-    if (now - last_fps_time >= 1000)    // update once per second
+// winmm.dll at run time, as not every build line links winmm.lib
+typedef UINT (WINAPI *timePeriod_t)(UINT);
+
+static int SDLCALL P_SamplerThread(void *data)
+{
+    const Uint64 start = SDL_GetTicksNS();
+    const HMODULE winmm = LoadLibraryA("winmm.dll");
+    const timePeriod_t begin_period = winmm ? (timePeriod_t)(void *)GetProcAddress(winmm, "timeBeginPeriod") : NULL;
+    const timePeriod_t end_period = winmm ? (timePeriod_t)(void *)GetProcAddress(winmm, "timeEndPeriod") : NULL;
+    const bool period = begin_period && end_period && begin_period(PROF_INTERVAL_MS) == TIMERR_NOERROR;
+
+    (void)data;
+
+    // Sleep(1) lasts a whole scheduler tick (15.6 ms) at the default
+    // resolution; the report gives the interval achieved either way
+
+    while (!SDL_GetAtomicInt(&prof_quit) && prof_count < PROF_SAMPLES)
     {
-        fps = frame_count;
-        frame_count = 0;
-        last_fps_time = now;
+        CONTEXT ctx;
+
+        Sleep(PROF_INTERVAL_MS);
+
+        // Nothing may allocate or lock while the main thread is stopped
+        if (SuspendThread(prof_target) == (DWORD)-1)
+            break;
+
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.ContextFlags = CONTEXT_CONTROL;
+
+        if (GetThreadContext(prof_target, &ctx))
+        {
+#if defined(_M_X64) || defined(__x86_64__)
+            prof_samples[prof_count].ip = ctx.Rip;
+#elif defined(_M_ARM64) || defined(__aarch64__)
+            prof_samples[prof_count].ip = ctx.Pc;
+#else
+            prof_samples[prof_count].ip = ctx.Eip;
+#endif
+            prof_samples[prof_count].phase = (int)prof_phase;
+            prof_count++;
+        }
+
+        ResumeThread(prof_target);
     }
 
-    snprintf(fps_text, sizeof(fps_text), "FPS: %d", fps);
-    SDL_SetRenderDrawColor(sdl_renderer, 96, 176, 255, 172);
-    SDL_SetRenderScale(sdl_renderer, 1.5f, 1.5f);
-    SDL_RenderDebugText(sdl_renderer, 0, 10, fps_text);
-    SDL_SetRenderScale(sdl_renderer, 1.0f, 1.0f);
+    if (period)
+        end_period(PROF_INTERVAL_MS);
+    if (winmm)
+        FreeLibrary(winmm);
+    prof_elapsed_ns = SDL_GetTicksNS() - start;
+    return 0;
 }
 
-// -----------------------------------------------------------------------------
-// Input
-// -----------------------------------------------------------------------------
-
-static void I_ToggleFullScreen(bool enable)
+static bool P_StartProfiler(int top)
 {
-    // Toggle fullscreen and handle cursor/screensaver
-    SDL_SetWindowFullscreen(sdl_window, enable); // SDL3 bool API
-    if (enable)
+    prof_samples = malloc(PROF_SAMPLES * sizeof(*prof_samples));
+
+    if (!prof_samples
+    ||  !DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &prof_target,
+                         THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, 0))
     {
-        SDL_HideCursor();
-        SDL_DisableScreenSaver();
+        SDL_Log("Profiler: no access to the main thread");
+        free(prof_samples);
+        prof_samples = NULL;
+        return false;
     }
-    else
+
+    prof_top = top;
+    SDL_SetAtomicInt(&prof_quit, 0);
+    prof_thread = SDL_CreateThread(P_SamplerThread, "profiler", NULL);
+
+    if (!prof_thread)
     {
-        SDL_ShowCursor();
-        SDL_EnableScreenSaver();
+        SDL_Log("SDL_CreateThread failed: %s", SDL_GetError());
+        CloseHandle(prof_target);
+        free(prof_samples);
+        prof_samples = NULL;
+        return false;
     }
 
-    // Update config variable
-    FULLSCREEN = enable;
+    return true;
 }
 
-// TODO?
-// char stats[64];
-// R_DrawText(ren, "Starry Sky", 10, 10, 255, 255, 200, 255);
-// R_DrawText(ren, "F11: toggle fullscreen | SPACE: toggle colors", 10, 25, 180, 180, 255, 255);
-// R_DrawText(ren, stats, 10, 40, 200, 255, 200, 255);
+static int P_CompareSamples(const void *a, const void *b)
+{
+    const DWORD64 x = ((const prof_sample_t *)a)->ip, y = ((const prof_sample_t *)b)->ip;
+    return (x > y) - (x < y);
+}
 
-static void MSG_SetMessage(const char *message, int x, int y,
-                           int r, int g, int b, int a)
+static int P_CompareEntries(const void *a, const void *b)
 {
-    msg_timeout = 4 * TICRATE;
-    msg_text = message;
-    msg_x = x; msg_y = y;
-    msg_r = r; msg_g = g; msg_b = b; msg_a = a;
+    return ((const prof_entry_t *)b)->count - ((const prof_entry_t *)a)->count;
 }
 
+//
+// Symbolize with dbghelp.dll when it can be loaded; otherwise addresses
+// are reported as offsets into the executable, for a map file.
+//
+
+typedef BOOL (WINAPI *SymInitialize_t)(HANDLE, PCSTR, BOOL);
+typedef BOOL (WINAPI *SymFromAddr_t)(HANDLE, DWORD64, PDWORD64, PSYMBOL_INFO);
+typedef BOOL (WINAPI *SymCleanup_t)(HANDLE);
+
+static void P_StopProfiler(void)
+{
+    if (!prof_thread)
+        return;
+
+    SDL_SetAtomicInt(&prof_quit, 1);
+    SDL_WaitThread(prof_thread, NULL);
+    prof_thread = NULL;
+    CloseHandle(prof_target);
+
+    const HANDLE process = GetCurrentProcess();
+    const HMODULE dbghelp = LoadLibraryA("dbghelp.dll");
+    const SymInitialize_t sym_init = dbghelp ? (SymInitialize_t)(void *)GetProcAddress(dbghelp, "SymInitialize") : NULL;
+    const SymFromAddr_t sym_from_addr = dbghelp ? (SymFromAddr_t)(void *)GetProcAddress(dbghelp, "SymFromAddr") : NULL;
+    const SymCleanup_t sym_cleanup = dbghelp ? (SymCleanup_t)(void *)GetProcAddress(dbghelp, "SymCleanup") : NULL;
+    const bool symbols = sym_init && sym_from_addr && sym_init(process, NULL, TRUE);
+    const DWORD64 base = (DWORD64)(uintptr_t)GetModuleHandleA(NULL);
+    prof_entry_t *entries = calloc(MAX(prof_count, 1), sizeof(*entries));
+    int num_entries = 0, phase_samples[NUMPHASES] = { 0 };
+    DWORD64 last_ip = 0, last_addr = 0;
+    char last_name[64] = "";
+
+    // Sorted by address, each distinct address is resolved once
+    qsort(prof_samples, prof_count, sizeof(*prof_samples), P_CompareSamples);
+
+    for (int i = 0; entries && i < prof_count; i++)
+    {
+        const DWORD64 ip = prof_samples[i].ip;
+
+        phase_samples[prof_samples[i].phase]++;
+
+        if (i == 0 || ip != last_ip)
+        {
+            union { SYMBOL_INFO info; char buf[sizeof(SYMBOL_INFO) + 64]; } sym;
+            DWORD64 displacement = 0;
+
+            memset(&sym, 0, sizeof(sym));
+            sym.info.SizeOfStruct = sizeof(SYMBOL_INFO);
+            sym.info.MaxNameLen = 64;
+
+            if (symbols && sym_from_addr(process, ip, &displacement, &sym.info))
+            {
+                last_addr = sym.info.Address;
+                snprintf(last_name, sizeof(last_name), "%s", sym.info.Name);
+            }
+            else
+            {
+                last_addr = ip;
+                snprintf(last_name, sizeof(last_name), "exe+0x%llx", (unsigned long long)(ip - base));
+            }
+            last_ip = ip;
+        }
+
+        // Samples of one function are adjacent, except for unresolved gaps
+        prof_entry_t *e = num_entries ? &entries[num_entries - 1] : NULL;
+
+        if (!e || e->addr != last_addr)
+        {
+            e = &entries[num_entries++];
+            e->addr = last_addr;
+            snprintf(e->name, sizeof(e->name), "%s", last_name);
+        }
+
+        e->count++;
+        e->phases[prof_samples[i].phase]++;
+    }
+
+    if (symbols && sym_cleanup)
+        sym_cleanup(process);
+
+    qsort(entries, num_entries, sizeof(*entries), P_CompareEntries);
+
+    // The interval actually achieved, timer resolution permitting
+    printf("Profile: %d samples every %.2f ms\n", prof_count,
+           prof_count ? prof_elapsed_ns / 1e6 / prof_count : (double)PROF_INTERVAL_MS);
+    for (int p = 0; p < NUMPHASES; p++)
+        printf("  %-8s %5.1f%%\n", phase_names[p], 100.0 * phase_samples[p] / MAX(prof_count, 1));
+
+    printf("  %6s  %-40s  %s\n", "self", "function", "phases");
+    for (int i = 0; i < MIN(num_entries, prof_top); i++)
+    {
+        char phases[128] = "";
+        size_t len = 0;
+
+        for (int p = 0; p < NUMPHASES; p++)
+        {
+            if (entries[i].phases[p] && len < sizeof(phases))
+                len += snprintf(phases + len, sizeof(phases) - len, "%s %d%% ", phase_names[p],
+                                100 * entries[i].phases[p] / entries[i].count);
+        }
+
+        printf("  %5.1f%%  %-40s  %s\n", 100.0 * entries[i].count / MAX(prof_count, 1), entries[i].name, phases);
+    }
+
+    P_PrintPhaseJSON(stdout, NUM_STARS);
+
+    free(entries);
+    free(prof_samples);
+    prof_samples = NULL;
+    if (dbghelp)
+        FreeLibrary(dbghelp);
+}
 
 // -----------------------------------------------------------------------------
 // Main loop
@@ -480,8 +5796,51 @@ int main(int argc, char **argv)
         SetConsoleCP(CP_UTF8);
     }
 
+    // Offline panorama tiler: -maketiles in.bmp out.sky
+    for (int i = 1; i < argc - 2; i++)
+    {
+        if (strcmp(argv[i], "-maketiles") == 0)
+            return R_MakeTiles(argv[i + 1], argv[i + 2]);
+    }
+
     // Initialize RNG/LCG 
     m_rand_seed = (uint32_t)time(NULL);
+    const uint32_t start_seed = m_rand_seed;
+
+    // Lockstep: processes on this host share a seed and the leader's clock.
+    // Simulation then steps once per tic, so all of them compute the same
+    // field; runtime key changes are local and will break the sync.
+    //  -headless   simulate only, no window
+    //  -display N  show only display N of the spanned layout
+    //  -framehash  print a hash of the field for every tic
+    //  -tics N     quit after N tics
+    //  -locksteptest N  run N of these and compare their hashes
+    const bool headless  = M_CheckParm("-headless", argc, argv);
+    const bool framehash = M_CheckParm("-framehash", argc, argv);
+    const int  display   = M_ParmValue("-display", -1, argc, argv);
+    const int  max_tics  = M_ParmValue("-tics", 0, argc, argv);
+
+    // -locksteptest N: N headless lockstep processes, their hashes compared
+    if (M_CheckParm("-locksteptest", argc, argv))
+        return LS_RunTest(M_ParmValue("-locksteptest", 2, argc, argv), max_tics > 0 ? max_tics : 500);
+
+    // -profile [N]: sample the main thread, print the top N functions at exit
+    if (M_CheckParm("-profile", argc, argv))
+        P_StartProfiler(MAX(M_ParmValue("-profile", 20, argc, argv), 1));
+
+    if (M_CheckParm("-lockstep", argc, argv) && !LS_Init())
+        SDL_Log("Lockstep mode disabled");
+
+    // One writer for stars.ini: headless runs and lockstep followers (a
+    // -locksteptest starts several at once) leave it alone
+    const bool save_config = !headless && !(lockstep && !lockstep_leader);
+
+    // Reference consumer of -export, runs until closed
+    if (M_CheckParm("-exportreader", argc, argv))
+        return EX_RunReader();
+
+    // Console output from here on goes through the log flusher
+    LOG_Init();
 
     // Read config file if exist. Otherwise, create a new one with defaults.
     const bool had_cfg = CFG_Load(CONFIG_FILENAME);
@@ -489,56 +5848,166 @@ int main(int argc, char **argv)
     // Check config variables.
     CFG_Check();
 
+    // Scene playlist starts with its first scene
+    PL_Init();
+
     // No config file? Make a new one.
-    if (!had_cfg)
+    if (!had_cfg && save_config)
     CFG_Save(CONFIG_FILENAME);
 
+    // -jobbench measures the job workers and quits
+    if (M_CheckParm("-jobbench", argc, argv))
+    {
+        J_Init();
+        const int result = J_RunBenchmark();
+        J_Shutdown();
+        LOG_Shutdown();
+        return result;
+    }
+
+    // -simbench [N]: updates only, over N stars for -tics tics, no window
+    if (M_CheckParm("-simbench", argc, argv))
+    {
+        const int count = M_ParmValue("-simbench", SIMBENCH_STARS, argc, argv);
+        const int result = R_RunSimBenchmark(count > 0 ? count : SIMBENCH_STARS,
+                                             max_tics > 0 ? max_tics : SIMBENCH_TICS);
+        J_Shutdown();
+        LOG_Shutdown();
+        return result;
+    }
+
     // Check for video output.
-    if (!SDL_Init(SDL_INIT_VIDEO))
+    if (!SDL_Init(headless ? 0 : SDL_INIT_VIDEO))
     {
         SDL_Log("SDL_Init failed: %s", SDL_GetError());
         return 1;
     }
 
-    // Create window + renderer (let SDL pick the best driver)
-    sdl_window = SDL_CreateWindow("Starry Sky", 800, 600, SDL_WINDOW_RESIZABLE);
-    if (!sdl_window)
+    // One window per display when spanning (needs at least two displays)
+    spanning = !headless && (SPAN_DISPLAYS || display >= 0) && I_InitSpanViews(display);
+
+    if (headless)
     {
-        SDL_Log("SDL_CreateWindow failed: %s", SDL_GetError());
-        SDL_Quit();
-        return 1;
+        R_InitStars(NUM_STARS, world_w, world_h);
     }
-
-    sdl_renderer = SDL_CreateRenderer(sdl_window, NULL);
-    if (!sdl_renderer)
+    else if (!spanning)
     {
-        SDL_Log("SDL_CreateRenderer failed: %s", SDL_GetError());
-        SDL_DestroyWindow(sdl_window);
-        SDL_Quit();
-        return 1;
+        // Create window + renderer (let SDL pick the best driver)
+        sdl_window = SDL_CreateWindow("Starry Sky", 800, 600, SDL_WINDOW_RESIZABLE);
+        if (!sdl_window)
+        {
+            SDL_Log("SDL_CreateWindow failed: %s", SDL_GetError());
+            SDL_Quit();
+            return 1;
+        }
+
+        sdl_renderer = SDL_CreateRenderer(sdl_window, NULL);
+        if (!sdl_renderer)
+        {
+            SDL_Log("SDL_CreateRenderer failed: %s", SDL_GetError());
+            SDL_DestroyWindow(sdl_window);
+            SDL_Quit();
+            return 1;
+        }
+
+        views[0].window = sdl_window;
+        views[0].renderer = sdl_renderer;
+        num_views = 1;
     }
 
+    // Primary view carries messages and FPS counter
+    sdl_window = views[0].window;
+    sdl_renderer = views[0].renderer;
+
     // Initialize timer
     last_tic_time = SDL_GetTicks();
 
-    SDL_GetRenderOutputSize(sdl_renderer, &render_w, &render_h); // pixels
-    R_InitStars(NUM_STARS, render_w, render_h);
+    bool is_fullscreen = FULLSCREEN;
+
+    // Start in full screen mode, if config variable set to 1. The field is
+    // sized (and in lockstep, published) once the window has its final size.
+    if (is_fullscreen && !spanning && !headless)
+    {
+        I_ToggleFullScreen(true);
+        SDL_SyncWindow(sdl_window);
+    }
+
+    if (!headless)
+    {
+        I_UpdateFieldSize(true);
+        SS_Init();
+    }
+
+    // Frame export: slots sized for the primary display, so it can go fullscreen
+    if (!headless && M_CheckParm("-export", argc, argv))
+    {
+        SDL_Rect bounds = { 0, 0, render_w, render_h };
+        SDL_GetDisplayBounds(SDL_GetDisplayForWindow(sdl_window), &bounds);
+        EX_Init(MAX(bounds.w, render_w), MAX(bounds.h, render_h));
+    }
+
+    // Leader shares the seed it started from, followers start over from it
+    if (lockstep)
+    {
+        if (lockstep_leader)
+        {
+            LS_Publish(start_seed, world_w, world_h);
+        }
+        else if (LS_Join(&m_rand_seed, &world_w, &world_h))
+        {
+            R_InitStarGrid(world_w, world_h);
+            R_InitStars(NUM_STARS, world_w, world_h);
+        }
+        else
+        {
+            LS_Shutdown();
+        }
+    }
+
+    const bool tic_locked = lockstep || headless;
+    Uint64 sim_tic = 0;                   // updates done in tic-locked mode
+
+    // Background respawns use their own RNG, not for tic-locked runs
+    if (RESPAWN_RING && !COUNTER_RNG && !tic_locked)
+        R_StartRespawnThread();
 
     bool running = true;
-    bool is_fullscreen = FULLSCREEN;
 
-    // Start in full screen mode, if config variable set to 1
-    if (is_fullscreen)
-    I_ToggleFullScreen(true);
+    Uint64 last_frame_time = SDL_GetTicks();
+    Uint32 last_frame_key = 0, last_hud_key = 0;
+    bool redraw = true;                   // windows need a present regardless
+
+    // Background work for the slack between frames
+    if (!headless)
+    {
+        R_ReachSprites(zoom);
+        I_AddIdleTask("sprites", R_PrebuildSprites, true);
+        I_AddIdleTask("pano upload", R_UploadPanoTiles, false);
+        I_AddIdleTask("scene prewarm", PL_PrewarmField, true);
+        I_AddIdleTask("scene sprites", PL_PrewarmTextures, false);
+    }
 
     while (running)
     {
         // Frame rate independent timer
         I_Ticker();
 
+        // A frame that took more than three frame intervals is a visible
+        // hitch. Frames come DELAY_MS apart, or a tic apart when paced by
+        // tics (tic-locked, or nothing changed), whichever is longer.
+        const Uint64 frame_time = SDL_GetTicks();
+        if (frame_time - last_frame_time > 3 * (Uint64)MAX(DELAY_MS, TIC_DURATION_MS))
+            LOG_Printf("Frame drop: %llu ms at tic %llu", (unsigned long long)(frame_time - last_frame_time),
+                       (unsigned long long)gametic);
+        last_frame_time = frame_time;
+
+        if (max_tics > 0 && gametic >= (Uint64)max_tics)
+            running = false;
+
         // Handle events
+        P_SetPhase(PH_EVENTS);
         SDL_Event ev;
-        while (SDL_PollEvent(&ev))
+        while (!headless && SDL_PollEvent(&ev))
         {
             switch (ev.type)
             {
@@ -563,7 +6032,18 @@ int main(int argc, char **argv)
                         MSG_SetMessage(SHOW_FPS ? "FPS counter ON" : "FPS counter OFF",
                                        0, 0, 96, 176, 255, 255);
                     }
-                    else if ( sc == SDL_SCANCODE_F11 || ((sc == SDL_SCANCODE_RETURN || sc == SDL_SCANCODE_KP_ENTER) && (mods & SDL_KMOD_ALT)))
+#ifdef R_TILESTATS
+                    else if (sc == SDL_SCANCODE_F6)
+                    {
+                        // Toggle per-tile cost overlay
+                        show_tiles ^= 1;
+                        memset(tile_frags, 0, sizeof(tile_frags));
+                        memset(tile_quads, 0, sizeof(tile_quads));
+                        MSG_SetMessage(show_tiles ? "Tile cost overlay ON" : "Tile cost overlay OFF",
+                                       0, 0, 96, 176, 255, 255);
+                    }
+#endif
+                    else if (!spanning && (sc == SDL_SCANCODE_F11 || ((sc == SDL_SCANCODE_RETURN || sc == SDL_SCANCODE_KP_ENTER) && (mods & SDL_KMOD_ALT))))
                     {
                         // Toggle full screen
                         is_fullscreen = !is_fullscreen;
@@ -576,6 +6056,68 @@ int main(int argc, char **argv)
                         MSG_SetMessage(COLORED_STARS ? "Colored stars" : "Grayscale stars",
                                        0, 0, 96, 176, 255, 255);
                     }
+                    else if (sc == SDL_SCANCODE_F12)
+                    {
+                        // Screenshot of the next frame
+                        shot_pending = true;
+                    }
+                    else if (sc == SDL_SCANCODE_EQUALS || sc == SDL_SCANCODE_KP_PLUS
+                          || sc == SDL_SCANCODE_MINUS || sc == SDL_SCANCODE_KP_MINUS)
+                    {
+                        // Zoom around the mouse cursor
+                        const bool in = (sc == SDL_SCANCODE_EQUALS || sc == SDL_SCANCODE_KP_PLUS);
+                        const view_t *view = I_ViewForWindow(ev.key.windowID);
+                        float mx, my;
+
+                        SDL_GetMouseState(&mx, &my);
+                        I_ZoomAt(view, mx, my, in ? 1.25f : 0.8f);
+                        MSG_SetMessage(msg_buffer, 0, 0, 96, 176, 255, 255);
+                    }
+                    else if (sc == SDL_SCANCODE_0 || sc == SDL_SCANCODE_KP_0)
+                    {
+                        // Reset zoom
+                        zoom = 1.0f;
+                        cam_x = cam_y = 0;
+                        MSG_SetMessage("Zoom: 1.00x", 0, 0, 96, 176, 255, 255);
+                    }
+                    else if (sc == SDL_SCANCODE_F)
+                    {
+                        // Toggle flow field
+                        FLOW_FIELD ^= 1;
+                        MSG_SetMessage(FLOW_FIELD ? "Flow field ON" : "Flow field OFF",
+                                       0, 0, 96, 176, 255, 255);
+                    }
+                    else if (sc == SDL_SCANCODE_M)
+                    {
+                        // Toggle motion blur
+                        MOTION_BLUR ^= 1;
+                        R_SaveMotion(MAXSTARS);
+                        MSG_SetMessage(MOTION_BLUR ? "Motion blur ON" : "Motion blur OFF",
+                                       0, 0, 96, 176, 255, 255);
+                    }
+                    else if (sc == SDL_SCANCODE_P)
+                    {
+                        // Toggle panorama
+                        PANORAMA ^= 1;
+                        pano_failed = false;
+                        if (PANORAMA && !R_OpenPanorama())
+                        {
+                            PANORAMA = 0;
+                            MSG_SetMessage("No " PANORAMA_FILENAME " (make one with -maketiles)", 0, 0, 96, 176, 255, 255);
+                        }
+                        else
+                        {
+                            MSG_SetMessage(PANORAMA ? "Panorama ON" : "Panorama OFF", 0, 0, 96, 176, 255, 255);
+                        }
+                    }
+                    else if (sc == SDL_SCANCODE_A)
+                    {
+                        // Toggle aurora
+                        AURORA ^= 1;
+                        aurora_failed = false;    // worth another try
+                        MSG_SetMessage(AURORA ? "Aurora ON" : "Aurora OFF",
+                                       0, 0, 96, 176, 255, 255);
+                    }
                     else if (sc == SDL_SCANCODE_COMMA && STAR_SIZE > 1)
                     {
                         // Decrease star size
@@ -583,7 +6125,7 @@ int main(int argc, char **argv)
                         snprintf(msg_buffer, sizeof(msg_buffer), "Star size: %d", STAR_SIZE);
                         MSG_SetMessage(msg_buffer, 0, 0, 96, 176, 255, 255);
                     }
-                    else if (sc == SDL_SCANCODE_PERIOD && STAR_SIZE < 16)
+                    else if (sc == SDL_SCANCODE_PERIOD && STAR_SIZE < MAXSIZE)
                     {
                         // Increase star size
                         STAR_SIZE++;
@@ -623,40 +6165,194 @@ int main(int argc, char **argv)
                 }
 
                 case SDL_EVENT_MOUSE_BUTTON_DOWN:
-                    if (ev.button.button == SDL_BUTTON_LEFT && ev.button.clicks >= 2)
+                    if (!spanning && ev.button.button == SDL_BUTTON_LEFT && ev.button.clicks >= 2)
                     {
                         is_fullscreen = !is_fullscreen;
                         I_ToggleFullScreen(is_fullscreen);
                     }
                     break;
 
+                case SDL_EVENT_MOUSE_WHEEL:
+                    if (ev.wheel.y != 0)
+                    {
+                        I_ZoomAt(I_ViewForWindow(ev.wheel.windowID), ev.wheel.mouse_x, ev.wheel.mouse_y,
+                                 powf(1.25f, ev.wheel.y));
+                        MSG_SetMessage(msg_buffer, 0, 0, 96, 176, 255, 255);
+                    }
+                    break;
+
                 case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
                 case SDL_EVENT_WINDOW_RESIZED:
-                    SDL_GetRenderOutputSize(sdl_renderer, &render_w, &render_h);
                     // Update imideatelly on window resize
-                    R_InitStars(NUM_STARS, render_w, render_h);
+                    I_UpdateFieldSize(!spanning && !lockstep);
+                    LOG_Printf("Resized to %dx%d, field %dx%d", render_w, render_h, world_w, world_h);
+                    redraw = true;
+                    break;
+
+                case SDL_EVENT_WINDOW_EXPOSED:
+                    redraw = true;
+                    break;
+
+                case SDL_EVENT_RENDER_TARGETS_RESET:
+                case SDL_EVENT_RENDER_DEVICE_RESET:
+                    // Cached scenes are gone with the targets
+                    for (int v = 0; v < num_views; v++)
+                        views[v].scene_valid = false;
+                    redraw = true;
                     break;
             }
         }
 
-        // Update and draw!
-        R_UpdateStars(NUM_STARS, render_w, render_h);
-        R_DrawStars(NUM_STARS);
-        R_DrawMessages();
-        R_DrawFPS();
+        // Update once, then draw every view of the field
+        P_SetPhase(PH_UPDATE);
+
+        // Power profiles and the playlist change the field locally, not
+        // in tic-locked runs; power changes wait for a crossfade to end
+        if (!tic_locked)
+        {
+            if (!pl_fade_start)
+                PWR_Update(gametic);
+            PL_Update();
+        }
+
+        // Streaks cover everything the stars moved this frame. A tic-locked
+        // frame between two tics moves nothing and keeps the last streaks.
+        const bool updating = !tic_locked || sim_tic < gametic;
+
+        if (MOTION_BLUR && updating)
+            R_SaveMotion(NUM_STARS);
+
+        if (tic_locked)
+        {
+            // Counter-based field jumps straight to the leader's tic
+            if (COUNTER_RNG && gametic > sim_tic + 1)
+            {
+                R_SeekStars(MAXSTARS, world_w, world_h, gametic - 1);
+                sim_tic = gametic - 1;
+            }
+
+            // Deterministic: one update per tic, whatever the frame rate
+            while (sim_tic < gametic)
+            {
+                R_UpdateFlow(sim_tic, world_w, world_h, false);
+                R_UpdateStars(NUM_STARS, world_w, world_h);
+                sim_tic++;
+
+                if (framehash)
+                    printf("tic %llu hash %08x\n", (unsigned long long)sim_tic,
+                           (unsigned)R_HashStars(NUM_STARS));
+            }
+        }
+        else
+        {
+            R_UpdateFlow(gametic, world_w, world_h, true);
+            R_UpdateStars(NUM_STARS, world_w, world_h);
+        }
+
+        if (MOTION_BLUR && updating)
+            R_EndMotion(NUM_STARS, world_w, world_h);
+
+        PL_UpdateIncoming();
+
+        R_BuildStarGrid(NUM_STARS);
+
+        // Nothing on screen would change: keep the last presented frame
+        const Uint32 hud_key = I_HudKey();
+        frame_key = R_FrameKey();
+        const bool unchanged = STATIC_CACHE && !redraw && !shot_pending
+                            && frame_key == last_frame_key && hud_key == last_hud_key;
+
+        last_frame_key = frame_key;
+        last_hud_key = hud_key;
+        redraw = false;
+
+        for (int v = 0; v < num_views && !unchanged; v++)
+        {
+            P_SetPhase(PH_DRAW);
+            R_DrawStars(&views[v]);
+
+            if (v == 0)
+            {
+                P_SetPhase(PH_HUD);
+
+                // Star field without the HUD
+                if (export_hdr)
+                    EX_ExportFrame(sdl_renderer);
+
+                if (shot_pending)
+                {
+                    SS_Capture(sdl_renderer);
+                    shot_pending = false;
+                }
+
+                if (SDL_GetAtomicInt(&shot_done))
+                {
+                    SDL_SetAtomicInt(&shot_done, 0);
+                    snprintf(msg_buffer, sizeof(msg_buffer), "%s", shot_result);
+                    MSG_SetMessage(msg_buffer, 0, 0, 96, 176, 255, 255);
+                }
+
+#ifdef R_TILESTATS
+                R_DrawTileStats();
+#endif
+                R_DrawMessages();
+                R_DrawFPS();
+            }
 
-        SDL_RenderPresent(sdl_renderer);
+            P_SetPhase(PH_PRESENT);
+            SDL_RenderPresent(views[v].renderer);
+        }
 
-        if (DELAY_MS > 0)
-            SDL_Delay((Uint32)DELAY_MS);
+        // Pacing: the next frame is due at the next tic, or DELAY_MS from
+        // now; idle tasks get the time in between
+        P_SetPhase(PH_IDLE);
+        if (tic_locked)
+        {
+            // Sleep until the next tic, so all processes present together
+            I_RunIdleTasks((last_tic_time + TIC_DURATION_MS) * 1000000ull);
+            while (gametic == sim_tic && !(max_tics > 0 && gametic >= (Uint64)max_tics))
+            {
+                SDL_Delay(1);
+                I_Ticker();
+            }
+        }
+        else if (unchanged)
+        {
+            // Block until the next tic, or until there's input
+            I_WaitUntil((last_tic_time + TIC_DURATION_MS) * 1000000ull, true);
+        }
+        else
+        {
+            I_WaitUntil(SDL_GetTicksNS() + DELAY_MS * 1000000ull, false);
+        }
     }
 
+    // Profile report, before the shutdown below shows up in it
+    P_StopProfiler();
+
+    if (framehash)
+        fflush(stdout);
+
     // Save config file on exit
-    CFG_Save(CONFIG_FILENAME);
+    PWR_Restore();
+    PL_Restore();
+    if (save_config)
+        CFG_Save(CONFIG_FILENAME);
 
     // Shut down SDL subsystems
-    SDL_DestroyRenderer(sdl_renderer);
-    SDL_DestroyWindow(sdl_window);
+    R_FreeAurora();
+    R_FreeStarGrid();
+    I_ShutdownViews();
+    LS_Shutdown();
+    EX_Shutdown();
+    SS_Shutdown();
+    R_StopRespawnThread();
+    R_ShutdownFlow();
+    I_ShutdownIdleTasks();
+    J_Shutdown();
+    R_FreeSpritePixels();
+    R_ClosePanorama();
+    LOG_Shutdown();
     SDL_Quit();
     return 0;
 }